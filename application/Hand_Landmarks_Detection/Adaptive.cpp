@@ -0,0 +1,77 @@
+#include "InferEngine.h"
+#include "ModelSelector.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+// Runs each frame on the lite or the full engine, as a ModelSelector
+// picks. Only the models are borrowed: detection, tracking and the crops
+// stay with this engine, so switching models keeps following the hand.
+//
+// The tensor views are moved to the engine picked for the next frame as
+// soon as the last one is done, so callers preprocess straight into the
+// model that runs it and nothing is copied between the two.
+class AdaptiveInferEngine final : public InferEngine {
+public:
+    AdaptiveInferEngine(std::shared_ptr<InferEngine> lite, std::shared_ptr<InferEngine> full)
+        : m_lite(std::move(lite)), m_full(std::move(full)) {
+        for (const auto& step : m_lite->startup_steps())
+            m_startup.push_back({"lite: " + step.name, step.ms});
+        for (const auto& step : m_full->startup_steps())
+            m_startup.push_back({"full: " + step.name, step.ms});
+
+        bind(ModelVariant::Lite);
+    }
+
+    bool do_infer(const cv::Mat& land_data, std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces) override {
+        auto detected = InferEngine::do_infer(land_data, landmarks, faces);
+
+        // hands turned sideways are wider than tall
+        float hand = 0.0f;
+        if (detected && !landmarks.empty()) {
+            auto box = cv::boundingRect(landmarks);
+            hand = static_cast<float>(std::max(box.width, box.height)) / kHeight;
+        }
+
+        bind(m_selector.update(m_variant, m_stages, hand));
+        return detected;
+    }
+
+    bool invoke_detector() override { return m_active->invoke_detector(); }
+    bool invoke_landmark() override { return m_active->invoke_landmark(); }
+
+private:
+    std::shared_ptr<InferEngine> m_lite;
+    std::shared_ptr<InferEngine> m_full;
+    InferEngine* m_active = nullptr;
+    ModelVariant m_variant = ModelVariant::Lite;
+    ModelSelector m_selector;
+
+    void bind(ModelVariant variant) {
+        if (m_active != nullptr && variant == m_variant)
+            return;
+
+        m_variant = variant;
+        m_active = (variant == ModelVariant::Full) ? m_full.get() : m_lite.get();
+
+        m_det_input = m_active->det_input();
+        m_det_boxes = m_active->det_boxes();
+        m_det_scores = m_active->det_scores();
+        m_land_input = m_active->land_input();
+        m_land_output = m_active->land_output();
+        m_land_presence = m_active->land_presence();
+    }
+};
+
+// static
+std::unique_ptr<InferEngine> InferEngine::create_adaptive_engine(std::shared_ptr<InferEngine> lite,
+                                                                 std::shared_ptr<InferEngine> full) {
+    if (!lite || !full) {
+        std::cerr << "error: adaptive models need both the lite and the full engine.\n";
+        return nullptr;
+    }
+
+    return std::make_unique<AdaptiveInferEngine>(std::move(lite), std::move(full));
+}
@@ -0,0 +1,54 @@
+#include "Affinity.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <pthread.h>
+#include <sched.h>
+
+bool pin_current_thread(const std::vector<int>& cores) {
+    if (cores.empty())
+        return true;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto core : cores)
+        CPU_SET(core, &set);
+
+    if (auto err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); err != 0) {
+        std::cerr << "warning: failed to set thread affinity: " << strerror(err) << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<int> current_affinity() {
+    std::vector<int> cores;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        return cores;
+
+    for (auto i = 0; i < CPU_SETSIZE; ++i) {
+        if (CPU_ISSET(i, &set))
+            cores.push_back(i);
+    }
+
+    return cores;
+}
+
+std::vector<std::vector<int>> split_cores(int count) {
+    std::vector<std::vector<int>> sets(count);
+
+    auto cores = current_affinity();
+    auto per_set = cores.size() / count;
+    if (per_set == 0)
+        return sets;
+
+    for (auto i = 0; i < count; ++i)
+        sets[i].assign(cores.begin() + i * per_set, cores.begin() + (i + 1) * per_set);
+
+    return sets;
+}
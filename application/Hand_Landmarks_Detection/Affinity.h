@@ -0,0 +1,13 @@
+#pragma once
+
+#include <vector>
+
+// pin the calling thread to cores. empty cores is a no-op.
+bool pin_current_thread(const std::vector<int>& cores);
+
+// cores the calling thread may currently run on.
+std::vector<int> current_affinity();
+
+// split the online cores into count disjoint, equally sized sets.
+// returns empty sets if there are fewer cores than count.
+std::vector<std::vector<int>> split_cores(int count);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Defs.h"
+#include "InferEngine.h"
+
+#include <opencv2/core.hpp>
+
+#include <memory>
+#include <vector>
+
+// Palm detector over several frames per invocation, for offline
+// processing where latency does not matter but throughput does.
+//
+// Fill input(i) for each frame, invoke(), then hand boxes(i) and scores(i)
+// to InferEngine::do_infer() with detections. Only models whose graph
+// follows a batch dimension can be batched; create_tflite() fails for the others
+// and callers fall back to the engine's own detector.
+class BatchDetector {
+public:
+    virtual ~BatchDetector() noexcept = default;
+
+    int batch() const { return m_batch; }
+
+    // detInputSize x detInputSize CV_32FC3 view on the i-th slot of the input
+    cv::Mat& input(int i) { return m_inputs[i]; }
+
+    // raw outputs of the i-th slot, as InferEngine::det_boxes() and det_scores()
+    const float* boxes(int i) const { return m_boxes + static_cast<size_t>(i) * detclnum * 18; }
+    const float* scores(int i) const { return m_scores + static_cast<size_t>(i) * detclnum; }
+
+    // run all slots. slots not filled since the last call hold stale data.
+    virtual bool invoke() = 0;
+
+    static std::unique_ptr<BatchDetector> create_tflite(int batch, const XNNPackOptions& options = {},
+                                                        ModelVariant variant = ModelVariant::Lite);
+
+protected:
+    int m_batch = 1;
+    std::vector<cv::Mat> m_inputs;
+    const float* m_boxes = nullptr;
+    const float* m_scores = nullptr;
+};
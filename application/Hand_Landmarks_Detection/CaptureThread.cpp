@@ -0,0 +1,112 @@
+#include "CaptureThread.h"
+
+#include <iostream>
+
+int CaptureThread::start() {
+    if (!m_reader.isOpened()) {
+        std::cerr << "error: camera is not open.\n";
+        return 1;
+    }
+
+    m_run = true;
+    m_failed = false;
+    m_thread = std::thread(&CaptureThread::do_capture, this);
+
+    return 0;
+}
+
+void CaptureThread::stop() {
+    m_run = false;
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    // nobody reads anymore; answer what is left.
+    apply_requests();
+}
+
+bool CaptureThread::take(cv::Mat& frame, FrameStamp& stamp) {
+    if (!m_fresh)
+        return false;
+
+    cv::swap(frame, m_latest);
+    stamp = m_latest_stamp;
+    m_fresh = false;
+
+    return true;
+}
+
+bool CaptureThread::latest(cv::Mat& frame, FrameStamp& stamp) {
+    std::unique_lock lock(m_lock);
+    return take(frame, stamp);
+}
+
+bool CaptureThread::wait(cv::Mat& frame, FrameStamp& stamp, std::chrono::milliseconds timeout) {
+    std::unique_lock lock(m_lock);
+    m_cv.wait_for(lock, timeout, [this] { return m_fresh || m_failed; });
+
+    return take(frame, stamp);
+}
+
+double CaptureThread::set(int property, double value) {
+    std::future<double> result;
+
+    {
+        std::unique_lock lock(m_request_lock);
+        m_requests.push_back({property, value, {}});
+        result = m_requests.back().result.get_future();
+    }
+
+    // the capture thread is gone, so it is safe to touch the reader here.
+    if (!m_run || m_failed)
+        apply_requests();
+
+    return result.get();
+}
+
+CaptureThread::Stats CaptureThread::stats() const {
+    std::unique_lock lock(m_lock);
+    return m_stats;
+}
+
+void CaptureThread::apply_requests() {
+    std::unique_lock lock(m_request_lock);
+
+    for (auto& request : m_requests) {
+        m_reader.set(request.property, request.value);
+        request.result.set_value(m_reader.get(request.property));
+    }
+
+    m_requests.clear();
+}
+
+void CaptureThread::do_capture() {
+    int64_t sequence = 0;
+
+    while (m_run) {
+        apply_requests();
+
+        if (!m_reader.read(m_back)) {
+            std::cerr << "error: camera read error.\n";
+            m_failed = true;
+            m_cv.notify_all();
+            apply_requests();
+            break;
+        }
+
+        FrameStamp stamp{sequence++, clock::now()};
+
+        {
+            std::unique_lock lock(m_lock);
+            cv::swap(m_back, m_latest);
+            m_latest_stamp = stamp;
+
+            m_stats.captured += 1;
+            if (m_fresh)
+                m_stats.dropped += 1;
+            m_fresh = true;
+        }
+
+        m_cv.notify_one();
+    }
+}
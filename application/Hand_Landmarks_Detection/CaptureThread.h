@@ -0,0 +1,85 @@
+#pragma once
+
+#include "FrameStamp.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Reads a camera on its own thread so blocking I/O never stalls the
+// consumer.
+//
+// Frames go through three preallocated buffers: the one being read into,
+// the latest complete frame, and the one the consumer holds. Publishing
+// and taking a frame only swap Mat headers, so a slow consumer simply
+// skips frames (latest frame wins) and nothing is allocated per frame.
+class CaptureThread final {
+public:
+    using clock = FrameStamp::clock;
+
+    struct Stats {
+        int64_t captured = 0;
+        int64_t dropped = 0;  // replaced by a newer frame before taken
+    };
+
+    // reader must stay open and is only touched by the capture thread
+    // until stop().
+    explicit CaptureThread(cv::VideoCapture& reader)
+        : m_reader(reader) {}
+
+    ~CaptureThread() noexcept { stop(); }
+
+    int start();
+
+    void stop();
+
+    // swap the newest frame into frame if there is one not taken yet.
+    // never blocks.
+    bool latest(cv::Mat& frame, FrameStamp& stamp);
+
+    // like latest(), but wait up to timeout for a new frame.
+    bool wait(cv::Mat& frame, FrameStamp& stamp, std::chrono::milliseconds timeout);
+
+    // set a capture property between two reads and return the value the
+    // driver settled on.
+    double set(int property, double value);
+
+    // true once the camera failed to deliver a frame.
+    bool failed() const { return m_failed; }
+
+    Stats stats() const;
+
+private:
+    struct Request {
+        int property;
+        double value;
+        std::promise<double> result;
+    };
+
+    cv::VideoCapture& m_reader;
+    std::thread m_thread;
+    std::atomic<bool> m_run = false;
+    std::atomic<bool> m_failed = false;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_cv;
+    cv::Mat m_back;             // written by the capture thread only
+    cv::Mat m_latest;
+    FrameStamp m_latest_stamp;
+    bool m_fresh = false;
+    Stats m_stats;
+
+    std::mutex m_request_lock;
+    std::vector<Request> m_requests;
+
+    bool take(cv::Mat& frame, FrameStamp& stamp);
+    void apply_requests();
+    void do_capture();
+}; // end class CaptureThread
@@ -28,4 +28,78 @@ constexpr auto kFPS = 30.0f;
 constexpr auto kPerFrameMS = 16;
 
 constexpr auto kTFLite = false;
-constexpr auto kOptimium = true;
\ No newline at end of file
+constexpr auto kOptimium = true;
+
+// motion gate
+// frames are compared on a kGateWidth x kGateHeight luma thumbnail.
+constexpr int kGateWidth = 80;
+constexpr int kGateHeight = 60;
+constexpr float kMotionThreshold = 2.0f; // mean abs diff per pixel, 0 disables the gate
+constexpr int kMotionMaxSkip = 15; // force inference after this many skipped frames
+
+// threads used by each model of an engine
+constexpr int kEngineThreads = 2;
+
+// multi-stream serving
+constexpr int kMaxStreams = 8;
+constexpr auto kStreamDeadlineMS = 100; // frames waiting longer are dropped
+
+// xnnpack delegate of the tflite engine
+constexpr bool kXNNPackFp16 = false;
+constexpr bool kXNNPackQuantized = true;
+constexpr bool kXNNPackWeightCache = true; // persist packed weights next to the models
+
+// inferences run on dummy inputs before an engine reports ready
+constexpr int kWarmupRuns = 2;
+
+// capture thread
+constexpr int kCaptureTimeoutMS = 100; // wait for a new frame before checking the camera again
+
+// display pacing
+constexpr int kPacerWindow = 30; // presentations the achieved fps is measured over
+
+// thread budget
+constexpr int kReservedCores = 1; // main, capture and display threads
+
+// quality governor
+constexpr auto kGovernorPeriodMS = 1000; // how often the operating point is reconsidered
+constexpr float kGovernorSloMS = 100.0f; // capture to result p95 to hold
+constexpr float kGovernorHeadroom = 0.6f; // step up only while p95 is below this share of the slo
+constexpr float kGovernorHotCelsius = 75.0f; // step down at or above, the firmware throttles at 80
+constexpr float kGovernorCoolCelsius = 65.0f; // step up only below
+constexpr float kGovernorThrottledRatio = 0.9f; // cpu0 clock below this share of its max is throttled
+constexpr int kGovernorHold = 5; // calm periods in a row before stepping up
+constexpr int kGovernorMinSamples = 10; // results needed before latency is trusted
+
+// result publishing
+constexpr auto kResultRingEnv = "RPI_DEMO_RESULT_RING"; // shared memory name to publish live results to, unset disables
+constexpr uint32_t kResultRingCapacity = 64; // results kept for slow readers
+
+// result log
+constexpr auto kResultLogEnv = "RPI_DEMO_RESULT_LOG"; // file to write live results to, .bin for binary, unset disables
+constexpr uint32_t kResultLogMagic = 0x484e524c;
+constexpr size_t kResultLogCapacity = 256; // results queued for the writer thread before dropping
+constexpr size_t kResultLogBuffer = 1 << 20; // bytes gathered per write
+constexpr uint64_t kResultLogRotateBytes = 256ull << 20; // default file size before rotating
+constexpr auto kResultLogPollMS = 50; // writer thread drains the queue this often
+constexpr auto kResultLogFlushMS = 5000; // and writes out a partial buffer this often
+
+// raw frame files
+constexpr uint32_t kFrameFileMagic = 0x484e5246;
+constexpr auto kRecordRawEnv = "RPI_DEMO_RECORD_RAW"; // set to record .frames instead of MJPG
+
+// tensor capture
+constexpr auto kTensorCaptureEnv = "RPI_DEMO_TENSOR_CAPTURE"; // set to capture raw tensors in recorded mode
+
+// offline processing
+constexpr int64_t kOfflineMinShardFrames = 256; // shorter shards do not pay for loading an engine
+
+// adaptive models
+constexpr float kAdaptiveBudgetMS = 1000.0f / kFPS; // inference time one frame may take
+constexpr float kAdaptiveUpHeadroom = 0.7f; // move to full only if it is expected below this share of the budget
+constexpr float kAdaptiveDownHeadroom = 0.9f; // and back to lite once it is expected above this share
+constexpr float kAdaptiveSmallHand = 0.3f; // hand height over frame height below which full is worth it
+constexpr float kAdaptiveLargeHand = 0.4f; // and above which lite is good enough
+constexpr float kAdaptiveFullCost = 1.6f; // full over lite model time until measured
+constexpr float kAdaptiveSmoothing = 0.1f; // weight of the newest time in the running averages
+constexpr int kAdaptiveHold = 15; // frames in a row in favour of full before moving to it
@@ -0,0 +1,165 @@
+#include "EngineProvider.h"
+
+#include <iostream>
+#include <vector>
+
+const char* to_string(Kind kind) {
+    return (kind == Kind::TFLite) ? "TFLite" : "Optimium";
+}
+
+static std::unique_ptr<InferEngine> create_engine(EngineConfig config) {
+    if (config.kind == Kind::TFLite) {
+        XNNPackOptions options;
+        options.threads = config.threads;
+        return InferEngine::create_tflite_engine(options, config.variant);
+    }
+
+    return InferEngine::create_optimium_engine(config.threads, {}, config.variant);
+}
+
+void EngineProvider::prewarm(const EngineConfig& config) {
+    auto resolved = resolve(config);
+    auto& s = slot(resolved);
+
+    std::unique_lock lock(s.lock);
+    revive(s);
+    if (s.engine || s.failed || s.pending.valid())
+        return;
+
+    s.pending = std::async(std::launch::async, [this, resolved] { return create(resolved); });
+}
+
+InferEngine* EngineProvider::try_get(const EngineConfig& config) {
+    auto resolved = resolve(config);
+    auto& s = slot(resolved);
+
+    std::unique_lock lock(s.lock);
+    revive(s);
+    if (s.pending.valid() && s.pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        collect(resolved, s);
+
+    return s.engine.get();
+}
+
+InferEngine* EngineProvider::get(const EngineConfig& config) {
+    return share(config).get();
+}
+
+bool EngineProvider::failed(const EngineConfig& config) {
+    auto& s = slot(resolve(config));
+
+    std::unique_lock lock(s.lock);
+    return s.failed;
+}
+
+void EngineProvider::evict(const EngineConfig& config) {
+    auto resolved = resolve(config);
+    {
+        auto& s = slot(resolved);
+
+        std::unique_lock lock(s.lock);
+        if (s.pending.valid())
+            collect(resolved, s);
+
+        if (s.engine) {
+            s.evicted = s.engine;
+            s.engine.reset();
+        }
+    }
+
+    if (resolved.variant == ModelVariant::Adaptive) {
+        evict({resolved.kind, ModelVariant::Lite, resolved.threads});
+        evict({resolved.kind, ModelVariant::Full, resolved.threads});
+    }
+}
+
+void EngineProvider::reset() {
+    // adaptive engines fill their lite and full slots while loading, maybe
+    // new ones, so wait for every load without the map lock before dropping
+    // anything.
+    std::vector<Slot*> slots;
+    while (true) {
+        std::vector<Slot*> all;
+        {
+            std::unique_lock lock(m_lock);
+            for (auto& entry : m_slots)
+                all.push_back(&entry.second);
+        }
+
+        if (all.size() == slots.size())
+            break;
+
+        slots = std::move(all);
+        for (auto* s : slots) {
+            std::unique_lock slot_lock(s->lock);
+            if (s->pending.valid())
+                s->pending.wait();
+        }
+    }
+
+    for (auto* s : slots) {
+        std::unique_lock slot_lock(s->lock);
+        s->pending = {};
+        s->engine.reset();
+        s->evicted.reset();
+        s->failed = false;
+    }
+}
+
+EngineConfig EngineProvider::resolve(EngineConfig config) const {
+    if (config.threads <= 0)
+        config.threads = m_threads;
+    return config;
+}
+
+EngineProvider::Slot& EngineProvider::slot(const EngineConfig& config) {
+    // slots are never erased, so references stay valid without the lock.
+    std::unique_lock lock(m_lock);
+    return m_slots[config];
+}
+
+std::shared_ptr<InferEngine> EngineProvider::share(const EngineConfig& config) {
+    prewarm(config);
+
+    auto resolved = resolve(config);
+    auto& s = slot(resolved);
+
+    std::unique_lock lock(s.lock);
+    if (s.pending.valid())
+        collect(resolved, s);
+
+    return s.engine;
+}
+
+std::shared_ptr<InferEngine> EngineProvider::create(const EngineConfig& config) {
+    if (config.variant != ModelVariant::Adaptive)
+        return create_engine(config);
+
+    // full first, it is the one that may not be installed
+    auto full = share({config.kind, ModelVariant::Full, config.threads});
+    if (!full)
+        return nullptr;
+
+    return InferEngine::create_adaptive_engine(share({config.kind, ModelVariant::Lite, config.threads}), std::move(full));
+}
+
+void EngineProvider::revive(Slot& slot) {
+    if (!slot.engine)
+        slot.engine = slot.evicted.lock();
+}
+
+void EngineProvider::collect(const EngineConfig& config, Slot& slot) {
+    slot.engine = slot.pending.get();
+
+    if (!slot.engine) {
+        std::cerr << "error: failed to create " << to_string(config.kind) << " " << to_string(config.variant)
+                  << " engine with " << config.threads << " threads.\n";
+        slot.failed = true;
+        return;
+    }
+
+    std::cerr << to_string(config.kind) << " " << to_string(config.variant) << " (" << config.threads
+              << " threads) startup:\n";
+    for (const auto& step : slot.engine->startup_steps())
+        std::cerr << "  - " << step.name << ": " << step.ms << "ms\n";
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "InferEngine.h"
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+enum class Kind {
+    TFLite,
+    Optimium
+};
+
+const char* to_string(Kind kind);
+
+// what an engine is created with. threads of 0 take the provider's default.
+struct EngineConfig {
+    Kind kind = Kind::TFLite;
+    ModelVariant variant = ModelVariant::Lite;
+    int threads = 0;
+
+    EngineConfig() = default;
+    EngineConfig(Kind kind, ModelVariant variant = ModelVariant::Lite, int threads = 0)
+        : kind(kind), variant(variant), threads(threads) {}
+
+    bool operator<(const EngineConfig& other) const {
+        return std::tie(kind, variant, threads) < std::tie(other.kind, other.variant, other.threads);
+    }
+
+    bool operator==(const EngineConfig& other) const {
+        return kind == other.kind && variant == other.variant && threads == other.threads;
+    }
+
+    bool operator!=(const EngineConfig& other) const { return !(*this == other); }
+};
+
+// Creates engines on first use, or ahead of time in the background, so only
+// the backends that are actually used occupy memory. Adaptive engines are
+// built on the provider's own lite and full engines of the same backend and
+// threads, so no model is loaded twice. Engines a user has moved away from
+// can be evicted, so switching between configurations keeps only the ones
+// in use.
+class EngineProvider final {
+public:
+    ~EngineProvider() noexcept { reset(); }
+
+    // threads of engines created from now on without explicit threads.
+    void set_threads(int threads) { m_threads = threads; }
+
+    // start creating the engine in the background. no-op if already requested.
+    void prewarm(const EngineConfig& config);
+
+    // the engine if it is ready, nullptr otherwise. never blocks.
+    InferEngine* try_get(const EngineConfig& config);
+
+    // the engine, creating it or waiting for the prewarm if needed.
+    // nullptr if creation failed.
+    InferEngine* get(const EngineConfig& config);
+
+    // like get(), but shared: the engine outlives evict() while held.
+    std::shared_ptr<InferEngine> share(const EngineConfig& config);
+
+    bool failed(const EngineConfig& config);
+
+    // drop the provider's hold on the engine, and for adaptive engines on
+    // their lite and full ones. each is freed once nothing else shares it;
+    // until then asking for it again returns the same engine. pointers from
+    // get() and try_get() must not be used afterwards.
+    void evict(const EngineConfig& config);
+
+    void reset();
+
+private:
+    struct Slot {
+        std::mutex lock;
+        std::future<std::shared_ptr<InferEngine>> pending;
+        std::shared_ptr<InferEngine> engine;
+        std::weak_ptr<InferEngine> evicted;
+        bool failed = false;
+    };
+
+    std::mutex m_lock;
+    std::map<EngineConfig, Slot> m_slots;
+    std::atomic<int> m_threads = kEngineThreads;
+
+    EngineConfig resolve(EngineConfig config) const;
+    Slot& slot(const EngineConfig& config);
+    std::shared_ptr<InferEngine> create(const EngineConfig& config);
+
+    static void collect(const EngineConfig& config, Slot& slot);
+    static void revive(Slot& slot);
+};
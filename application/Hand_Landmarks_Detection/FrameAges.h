@@ -0,0 +1,68 @@
+#pragma once
+
+#include "FrameStamp.h"
+#include "LatencyWindow.h"
+
+#include <cstdint>
+
+// Age distributions of frames at each stage, measured from capture.
+//  - preprocess / infer: age of an inferred frame when it left the stage.
+//  - display: age of the frame the overlay was computed on when shown,
+//    i.e. what the user sees as capture to result latency.
+//  - frame: age of the camera frame itself when shown.
+class FrameAges final {
+public:
+    using clock = FrameStamp::clock;
+
+    explicit FrameAges(size_t capacity = 256)
+        : preprocess(capacity), infer(capacity), display(capacity), frame(capacity) {}
+
+    // a result was drawn over the frame shown at now.
+    void displayed(const FrameStamp& shown, const ResultStamp& result, clock::time_point now) {
+        frame.add(age(shown.captured, now));
+        m_displayed += 1;
+
+        if (result.frame.sequence < 0)
+            return;
+
+        display.add(age(result.frame.captured, now));
+
+        // a result is counted in the stage windows once, then reused.
+        if (result.frame.sequence == m_last_result) {
+            m_reused += 1;
+            return;
+        }
+
+        m_last_result = result.frame.sequence;
+        preprocess.add(age(result.frame.captured, result.preprocessed));
+        infer.add(age(result.frame.captured, result.inferred));
+    }
+
+    // shown frames whose overlay was already shown on an earlier frame.
+    int64_t reused() const { return m_reused; }
+    int64_t displayed() const { return m_displayed; }
+
+    void clear() {
+        preprocess.clear();
+        infer.clear();
+        display.clear();
+        frame.clear();
+        m_last_result = -1;
+        m_reused = 0;
+        m_displayed = 0;
+    }
+
+    LatencyWindow preprocess;
+    LatencyWindow infer;
+    LatencyWindow display;
+    LatencyWindow frame;
+
+private:
+    static float age(clock::time_point from, clock::time_point to) {
+        return std::chrono::duration<float, std::milli>(to - from).count();
+    }
+
+    int64_t m_last_result = -1;
+    int64_t m_reused = 0;
+    int64_t m_displayed = 0;
+};
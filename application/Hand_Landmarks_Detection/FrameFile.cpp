@@ -0,0 +1,249 @@
+#include "FrameFile.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr size_t kFramePage = 4096;
+
+static size_t round_to_page(size_t size) {
+    return (size + kFramePage - 1) / kFramePage * kFramePage;
+}
+
+static size_t bytes_per_pixel(RawFormat format) {
+    return (format == RawFormat::BGR24) ? 3 : 2;
+}
+
+static bool write_all(int fd, const void* data, size_t size) {
+    const auto* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        auto n = ::write(fd, bytes, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+// static
+bool FrameFileWriter::is_frame_file(const std::string& path) {
+    auto extension = std::string(".frames");
+    return path.size() >= extension.size() &&
+           path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+int FrameFileWriter::open(const std::string& path, cv::Size size, RawFormat format, float fps) {
+    close();
+
+    m_path = path;
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        std::cerr << "error: failed to open " << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    auto bytes = static_cast<size_t>(size.width) * size.height * bytes_per_pixel(format);
+
+    m_header = FrameFileHeader{};
+    m_header.header_size = kFramePage;
+    m_header.frame_size = round_to_page(bytes);
+    m_header.width = size.width;
+    m_header.height = size.height;
+    m_header.format = format;
+    m_header.fps = fps;
+    m_padding = m_header.frame_size - bytes;
+
+    std::vector<char> page(kFramePage, 0);
+    std::memcpy(page.data(), &m_header, sizeof(m_header));
+
+    if (!write_all(m_fd, page.data(), page.size())) {
+        std::cerr << "error: failed to write " << path << ": " << strerror(errno) << "\n";
+        close();
+        return 1;
+    }
+
+    return 0;
+}
+
+void FrameFileWriter::close() {
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+}
+
+int FrameFileWriter::append(const cv::Mat& frame) {
+    if (m_fd < 0)
+        return 1;
+
+    auto row = static_cast<size_t>(m_header.width) * bytes_per_pixel(m_header.format);
+    if (frame.cols != static_cast<int>(m_header.width) || frame.rows != static_cast<int>(m_header.height) ||
+        frame.elemSize() != bytes_per_pixel(m_header.format)) {
+        std::cerr << "error: frame does not match " << m_path << ".\n";
+        return 1;
+    }
+
+    // one write for the whole frame when rows are contiguous
+    bool ok = true;
+    if (frame.isContinuous()) {
+        ok = write_all(m_fd, frame.data, row * frame.rows);
+    } else {
+        for (auto y = 0; y < frame.rows && ok; ++y)
+            ok = write_all(m_fd, frame.ptr(y), row);
+    }
+
+    static const std::vector<char> zeros(kFramePage, 0);
+    if (ok && m_padding > 0)
+        ok = write_all(m_fd, zeros.data(), m_padding);
+
+    if (!ok) {
+        std::cerr << "error: failed to write " << m_path << ": " << strerror(errno) << "\n";
+        close();
+        return 1;
+    }
+
+    return 0;
+}
+
+bool FrameFileCapture::open(const std::string& path, int) {
+    release();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < static_cast<off_t>(kFramePage)) {
+        ::close(fd);
+        return false;
+    }
+
+    auto* memory = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+        return false;
+
+    std::memcpy(&m_header, memory, sizeof(m_header));
+
+    auto bytes = static_cast<size_t>(m_header.width) * m_header.height;
+    bool valid = m_header.magic == kFrameFileMagic && m_header.version == 1 && m_header.header_size == kFramePage &&
+                 (m_header.format == RawFormat::BGR24 || m_header.format == RawFormat::YUYV) &&
+                 m_header.frame_size >= bytes * bytes_per_pixel(m_header.format) && m_header.frame_size > 0;
+    if (!valid) {
+        munmap(memory, info.st_size);
+        return false;
+    }
+
+    m_memory = static_cast<char*>(memory);
+    m_length = info.st_size;
+    m_count = (m_length - kFramePage) / m_header.frame_size;
+    m_next = 0;
+    m_grabbed = -1;
+
+    // read ahead aggressively and drop pages behind
+    madvise(m_memory, m_length, MADV_SEQUENTIAL);
+    return true;
+}
+
+void FrameFileCapture::release() {
+    if (m_memory != nullptr)
+        munmap(m_memory, m_length);
+    m_memory = nullptr;
+    m_length = 0;
+    m_count = 0;
+}
+
+bool FrameFileCapture::grab() {
+    if (m_memory == nullptr || m_next >= m_count)
+        return false;
+
+    if (m_pace_fps > 0.0) {
+        auto now = clock::now();
+        if (m_due > now)
+            std::this_thread::sleep_until(m_due);
+        auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / m_pace_fps));
+        m_due = std::max(m_due, now) + period;
+    }
+
+    m_grabbed = m_next++;
+
+    // fault the next frame in while this one is used
+    if (m_next < m_count)
+        madvise(const_cast<char*>(frame_data(m_next)), m_header.frame_size, MADV_WILLNEED);
+
+    return true;
+}
+
+bool FrameFileCapture::retrieve(cv::OutputArray image, int) {
+    if (m_grabbed < 0)
+        return false;
+
+    auto* data = const_cast<char*>(frame_data(m_grabbed));
+    int rows = m_header.height;
+    int cols = m_header.width;
+
+    if (m_header.format == RawFormat::BGR24) {
+        image.assign(cv::Mat(rows, cols, CV_8UC3, data));
+    } else {
+        cv::cvtColor(cv::Mat(rows, cols, CV_8UC2, data), image, cv::COLOR_YUV2BGR_YUYV);
+    }
+
+    return true;
+}
+
+bool FrameFileCapture::read(cv::OutputArray image) {
+    if (!grab())
+        return false;
+    return retrieve(image);
+}
+
+cv::VideoCapture& FrameFileCapture::operator>>(cv::Mat& image) {
+    if (!read(image))
+        image = cv::Mat();
+    return *this;
+}
+
+bool FrameFileCapture::set(int property, double value) {
+    switch (property) {
+        case cv::CAP_PROP_POS_FRAMES:
+            m_next = std::clamp<int64_t>(static_cast<int64_t>(value), 0, m_count);
+            m_grabbed = -1;
+            return true;
+
+        case cv::CAP_PROP_FPS:
+            m_pace_fps = std::max(0.0, value);
+            m_due = clock::now();
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+double FrameFileCapture::get(int property) const {
+    switch (property) {
+        case cv::CAP_PROP_FRAME_WIDTH: return m_header.width;
+        case cv::CAP_PROP_FRAME_HEIGHT: return m_header.height;
+        case cv::CAP_PROP_FPS: return (m_pace_fps > 0.0) ? m_pace_fps : m_header.fps;
+        case cv::CAP_PROP_FRAME_COUNT: return static_cast<double>(m_count);
+        case cv::CAP_PROP_POS_FRAMES: return static_cast<double>(m_next);
+        case cv::CAP_PROP_FOURCC: return (m_header.format == RawFormat::BGR24) ? 0.0 : kYUYV;
+        default: return 0.0;
+    }
+}
+
+const char* FrameFileCapture::frame_data(int64_t index) const {
+    return m_memory + kFramePage + index * m_header.frame_size;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Defs.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Raw frame container: a FrameFileHeader page followed by fixed-size
+// frames, each padded to whole pages. Nothing to decode, so reading a
+// frame costs a page fault at most, and every run sees the same pixels.
+
+enum class RawFormat : uint32_t {
+    BGR24 = 1,  // CV_8UC3, as the pipeline consumes
+    YUYV = 2,   // CV_8UC2, as the camera delivers
+};
+
+struct FrameFileHeader {
+    uint32_t magic = kFrameFileMagic;
+    uint32_t version = 1;
+    uint32_t header_size;
+    uint32_t frame_size;   // bytes between frames
+    uint32_t width;
+    uint32_t height;
+    RawFormat format;
+    float fps;             // of the recording
+};
+
+// Appends frames. Not thread safe.
+class FrameFileWriter final {
+public:
+    FrameFileWriter() = default;
+    FrameFileWriter(const FrameFileWriter&) = delete;
+    FrameFileWriter& operator=(const FrameFileWriter&) = delete;
+
+    ~FrameFileWriter() noexcept { close(); }
+
+    // true if path names a raw frame file rather than a video.
+    static bool is_frame_file(const std::string& path);
+
+    int open(const std::string& path, cv::Size size, RawFormat format = RawFormat::BGR24, float fps = kFPS);
+    void close();
+
+    bool is_open() const { return m_fd >= 0; }
+
+    // frame must match the size and format the file was opened with.
+    int append(const cv::Mat& frame);
+
+private:
+    std::string m_path;
+    int m_fd = -1;
+    FrameFileHeader m_header{};
+    size_t m_padding = 0;
+};
+
+// Plays a frame file back through the cv::VideoCapture interface, so it
+// can stand in for the camera or a video anywhere one is read.
+//
+// The file is mapped and BGR frames are handed out as headers on the
+// mapping without a copy, valid until release(). The mapping is private,
+// so drawing on a frame never touches the file. Reads are as fast as the
+// caller asks unless CAP_PROP_FPS is set, which paces them like a camera.
+class FrameFileCapture final : public cv::VideoCapture {
+public:
+    FrameFileCapture() = default;
+    explicit FrameFileCapture(const std::string& path) { open(path); }
+
+    ~FrameFileCapture() override { release(); }
+
+    bool open(const std::string& path, int api = cv::CAP_ANY) override;
+    bool isOpened() const override { return m_memory != nullptr; }
+    void release() override;
+
+    bool grab() override;
+    bool retrieve(cv::OutputArray image, int flag = 0) override;
+    bool read(cv::OutputArray image) override;
+    cv::VideoCapture& operator>>(cv::Mat& image) override;
+
+    // CAP_PROP_POS_FRAMES seeks, CAP_PROP_FPS paces reads (0 does not).
+    bool set(int property, double value) override;
+    double get(int property) const override;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    char* m_memory = nullptr;
+    size_t m_length = 0;
+    FrameFileHeader m_header{};
+    int64_t m_count = 0;
+    int64_t m_next = 0;       // frame the next grab() takes
+    int64_t m_grabbed = -1;   // frame retrieve() returns
+
+    double m_pace_fps = 0.0;
+    clock::time_point m_due;
+
+    const char* frame_data(int64_t index) const;
+};
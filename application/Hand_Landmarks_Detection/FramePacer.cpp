@@ -0,0 +1,100 @@
+#include "FramePacer.h"
+
+#include <opencv2/highgui.hpp>
+
+int FramePacer::start() {
+    m_run = true;
+    m_thread = std::thread(&FramePacer::do_present, this);
+
+    return 0;
+}
+
+void FramePacer::stop() {
+    m_run = false;
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void FramePacer::submit(const cv::Mat& frame, Overlay overlay) {
+    std::unique_lock lock(m_lock);
+
+    frame.copyTo(m_pending);
+    m_pending_overlay = std::move(overlay);
+
+    if (m_fresh)
+        m_stats.dropped += 1;
+    m_fresh = true;
+}
+
+int FramePacer::key() {
+    std::unique_lock lock(m_lock);
+    if (m_keys.empty())
+        return -1;
+
+    auto key = m_keys.front();
+    m_keys.pop_front();
+    return key;
+}
+
+void FramePacer::set_fps(float fps) {
+    m_next_fps = fps;
+}
+
+FramePacer::Stats FramePacer::stats() const {
+    std::unique_lock lock(m_lock);
+    return m_stats;
+}
+
+void FramePacer::do_present() {
+    Overlay overlay;
+
+    while (m_run) {
+        if (auto fps = m_next_fps.exchange(0.0f); fps > 0.0f)
+            m_clock.set_fps(fps);
+
+        auto missed = m_clock.wait();
+
+        bool fresh;
+        {
+            std::unique_lock lock(m_lock);
+            fresh = m_fresh;
+            if (fresh) {
+                cv::swap(m_shown, m_pending);
+                std::swap(overlay, m_pending_overlay);
+                m_fresh = false;
+            }
+        }
+
+        if (fresh) {
+            if (overlay)
+                overlay(m_shown);
+            cv::imshow(m_window, m_shown);
+        }
+
+        // also pumps window events, so it runs on repeated ticks too.
+        auto key = cv::waitKey(1);
+
+        auto now = clock::now();
+        m_presents[m_present_count++ % kPacerWindow] = now;
+
+        std::unique_lock lock(m_lock);
+        if (key >= 0)
+            m_keys.push_back(key);
+
+        m_stats.missed += missed;
+        if (fresh)
+            m_stats.presented += 1;
+        else
+            m_stats.repeated += 1;
+
+        if (m_present_count > kPacerWindow) {
+            auto oldest = m_presents[m_present_count % kPacerWindow];
+            auto seconds = std::chrono::duration<float>(now - oldest).count();
+            m_stats.fps = (kPacerWindow - 1) / seconds;
+        }
+    }
+
+    cv::destroyWindow(m_window);
+    cv::waitKey(1);
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "Defs.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Ticks on absolute deadlines: the n-th tick is due at start + n * period,
+// so a late tick does not push back the ones after it. Ticks that are
+// already overdue are skipped instead of run back to back.
+class PaceClock final {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit PaceClock(float fps = kFPS) { set_fps(fps); }
+
+    // takes effect from the next tick on.
+    void set_fps(float fps) {
+        m_period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(1.0f / fps));
+        m_next = clock::now() + m_period;
+    }
+
+    clock::duration period() const { return m_period; }
+
+    // sleep until the next deadline. returns how many deadlines had already
+    // passed and were skipped.
+    int64_t wait() {
+        auto now = clock::now();
+        int64_t missed = 0;
+
+        if (now > m_next) {
+            missed = (now - m_next) / m_period;
+            m_next += m_period * missed;
+        }
+
+        std::this_thread::sleep_until(m_next);
+        m_next += m_period;
+
+        return missed;
+    }
+
+private:
+    clock::duration m_period;
+    clock::time_point m_next;
+};
+
+// Shows frames in a window at a fixed rate from its own thread.
+//
+// Producers submit frames whenever they have one; on every tick the newest
+// submission is rendered and shown, older unshown ones are dropped, and
+// the current picture is kept if nothing new arrived. Overlays are drawn on
+// the display thread right before the frame is shown. All HighGUI calls of
+// the window, including waitKey, happen on that thread; keys are handed
+// back through key().
+class FramePacer final {
+public:
+    using clock = PaceClock::clock;
+    using Overlay = std::function<void(cv::Mat&)>;
+
+    struct Stats {
+        float fps = 0.0f;           // achieved presentation rate
+        int64_t presented = 0;      // ticks that showed a new frame
+        int64_t repeated = 0;       // ticks that kept the previous frame
+        int64_t dropped = 0;        // submissions replaced before shown
+        int64_t missed = 0;         // deadlines passed while busy
+    };
+
+    explicit FramePacer(std::string window, float fps = kFPS)
+        : m_window(std::move(window)), m_clock(fps) {}
+
+    ~FramePacer() noexcept { stop(); }
+
+    int start();
+
+    // closes the window.
+    void stop();
+
+    // frame is copied; overlay runs on the display thread.
+    void submit(const cv::Mat& frame, Overlay overlay = {});
+
+    // oldest key pressed in the window not returned yet, -1 if none.
+    int key();
+
+    // change the target rate.
+    void set_fps(float fps);
+
+    Stats stats() const;
+
+private:
+    std::string m_window;
+    PaceClock m_clock;
+    std::atomic<float> m_next_fps = 0.0f;
+
+    std::thread m_thread;
+    std::atomic<bool> m_run = false;
+
+    mutable std::mutex m_lock;
+    cv::Mat m_pending;
+    Overlay m_pending_overlay;
+    bool m_fresh = false;
+    std::deque<int> m_keys;
+    Stats m_stats;
+
+    cv::Mat m_shown;                // display thread only
+    clock::time_point m_presents[kPacerWindow];
+    int64_t m_present_count = 0;
+
+    void do_present();
+}; // end class FramePacer
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Identity of a captured frame. travels with the frame through
+// preprocessing and inference into the result.
+struct FrameStamp {
+    using clock = std::chrono::steady_clock;
+
+    int64_t sequence = -1;          // capture order, -1 if unstamped
+    clock::time_point captured;     // when the frame was read from the camera
+};
+
+// When the frame a result was computed on went through each stage.
+struct ResultStamp {
+    FrameStamp frame;
+    FrameStamp::clock::time_point preprocessed;
+    FrameStamp::clock::time_point inferred;
+};
@@ -0,0 +1,133 @@
+#include "Governor.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+// value of a single number sysfs file, or -1 if it cannot be read.
+static long read_number(const std::string& path) {
+    std::ifstream file(path);
+    long value = -1;
+
+    if (!(file >> value))
+        return -1;
+
+    return value;
+}
+
+Governor::Governor(std::vector<OperatingPoint> points, size_t initial, GovernorOptions options)
+    : m_points(std::move(points)), m_disabled(m_points.size(), false),
+      m_index(std::min(initial, m_points.size() - 1)), m_options(std::move(options)),
+      m_latency(kGovernorPeriodMS * 2 * static_cast<size_t>(kFPS) / 1000),
+      m_next(clock::now() + std::chrono::milliseconds(kGovernorPeriodMS)) {}
+
+std::vector<OperatingPoint> Governor::default_points(int threads) {
+    auto fewer = std::max(1, threads - 1);
+
+    return {
+        { "full",                     ModelVariant::Full,     threads, 1, kFPS },
+        { "adaptive",                 ModelVariant::Adaptive, threads, 1, kFPS },
+        { "lite",                     ModelVariant::Lite,     threads, 1, kFPS },
+        { "lite, detect 1/2",         ModelVariant::Lite,     threads, 2, kFPS },
+        { "lite, detect 1/4",         ModelVariant::Lite,     threads, 4, kFPS },
+        { "lite, detect 1/4, cool",   ModelVariant::Lite,     fewer,   4, kFPS },
+        { "lite, detect 1/4, 15 fps", ModelVariant::Lite,     fewer,   4, kFPS / 2 },
+    };
+}
+
+bool Governor::update(clock::time_point now) {
+    if (now < m_next)
+        return false;
+    m_next = now + std::chrono::milliseconds(kGovernorPeriodMS);
+
+    m_readings.celsius = read_celsius();
+    m_readings.frequency_ratio = read_frequency_ratio();
+    m_readings.latency_ms = m_latency.percentile(95);
+
+    bool measured = m_latency.size() >= kGovernorMinSamples;
+    bool hot = m_readings.celsius >= m_options.hot_celsius;
+    bool throttled = m_readings.frequency_ratio >= 0.0f && m_readings.frequency_ratio < m_options.throttled_ratio;
+    bool slow = measured && m_readings.latency_ms > m_options.slo_ms;
+
+    bool cool = m_readings.celsius < m_options.cool_celsius;
+    bool fast = measured && m_readings.latency_ms < m_options.slo_ms * m_options.headroom;
+
+    // latency misses react at once. heat builds up slowly, so give the
+    // last step hold periods to show before taking another one.
+    if (slow || ((hot || throttled) && m_calm <= -m_options.hold)) {
+        auto next = neighbour(m_index, +1);
+        if (next != m_index) {
+            std::cerr << "governor: " << m_points[m_index].name << " -> " << m_points[next].name
+                      << " (p95 " << m_readings.latency_ms << "ms, " << m_readings.celsius << "C, clock "
+                      << m_readings.frequency_ratio << ")\n";
+            move_to(next);
+            return true;
+        }
+    }
+
+    if (!fast || !cool || throttled || hot) {
+        // count periods since the last change while not calm
+        m_calm = std::min(m_calm, 0) - 1;
+        return false;
+    }
+
+    if (++m_calm < m_options.hold)
+        return false;
+
+    auto next = neighbour(m_index, -1);
+    if (next == m_index)
+        return false;
+
+    std::cerr << "governor: " << m_points[m_index].name << " -> " << m_points[next].name
+              << " (p95 " << m_readings.latency_ms << "ms, " << m_readings.celsius << "C)\n";
+    move_to(next);
+    return true;
+}
+
+void Governor::disable(size_t index) {
+    if (index >= m_points.size())
+        return;
+
+    m_disabled[index] = true;
+    if (index != m_index)
+        return;
+
+    // prefer the cheaper side; the better one was just found unusable
+    auto next = neighbour(m_index, +1);
+    if (next == m_index)
+        next = neighbour(m_index, -1);
+    move_to(next);
+}
+
+size_t Governor::neighbour(size_t index, int step) const {
+    for (auto i = static_cast<long>(index) + step; i >= 0 && i < static_cast<long>(m_points.size()); i += step) {
+        if (!m_disabled[i])
+            return i;
+    }
+
+    return index;
+}
+
+void Governor::move_to(size_t index) {
+    m_index = index;
+    m_calm = 0;
+    m_latency.clear();
+}
+
+float Governor::read_celsius() const {
+    auto millicelsius = read_number(m_options.sysfs + "/class/thermal/thermal_zone0/temp");
+    return (millicelsius < 0) ? -1.0f : millicelsius / 1000.0f;
+}
+
+// read while the pipeline keeps the cores busy, so a low clock means the
+// firmware throttled rather than the ondemand governor idling.
+float Governor::read_frequency_ratio() const {
+    auto cpufreq = m_options.sysfs + "/devices/system/cpu/cpu0/cpufreq/";
+    auto current = read_number(cpufreq + "scaling_cur_freq");
+    auto max = read_number(cpufreq + "cpuinfo_max_freq");
+
+    if (current < 0 || max <= 0)
+        return -1.0f;
+
+    return static_cast<float>(current) / max;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Defs.h"
+#include "InferEngine.h"
+#include "LatencyWindow.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// One quality level the live pipeline can run at.
+struct OperatingPoint {
+    const char* name;
+    ModelVariant variant;
+    int threads;          // per model
+    int detect_interval;  // the palm detector runs on every n-th frame
+    float fps;            // camera and display rate
+};
+
+struct GovernorOptions {
+    std::string sysfs = "/sys";  // root of the thermal and cpufreq files
+    float slo_ms = kGovernorSloMS;
+    float headroom = kGovernorHeadroom;
+    float hot_celsius = kGovernorHotCelsius;
+    float cool_celsius = kGovernorCoolCelsius;
+    float throttled_ratio = kGovernorThrottledRatio;
+    int hold = kGovernorHold;
+};
+
+// Steps through operating points, ordered from best quality to cheapest,
+// to hold a capture to result latency objective on a board that heats up
+// and throttles.
+//
+// Latency over the objective moves one step cheaper right away. SoC
+// temperature at the hot mark or a throttled CPU clock also moves one step
+// cheaper, but only once the last step has had hold periods to show. Moving
+// back up needs latency well under the objective, a cool SoC and full
+// clocks for hold periods in a row, so the pipeline does not oscillate
+// around a threshold.
+class Governor final {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Readings {
+        float celsius = -1.0f;         // -1 if unknown
+        float frequency_ratio = -1.0f; // current / max clock, -1 if unknown
+        float latency_ms = 0.0f;       // p95 since the last change
+    };
+
+    Governor(std::vector<OperatingPoint> points, size_t initial, GovernorOptions options = {});
+
+    // capture to result latency of one inference.
+    void add_latency(float ms) { m_latency.add(ms); }
+
+    // reconsider the operating point at most every kGovernorPeriodMS.
+    // returns true if it changed.
+    bool update(clock::time_point now = clock::now());
+
+    // the point cannot be run, e.g. its models are missing. it is skipped
+    // from now on and the governor steps away if it is the current one.
+    void disable(size_t index);
+
+    size_t index() const { return m_index; }
+    const OperatingPoint& current() const { return m_points[m_index]; }
+    const Readings& readings() const { return m_readings; }
+
+    // full models, then adaptive, down to a quarter of the detector runs
+    // at half rate.
+    static std::vector<OperatingPoint> default_points(int threads);
+
+private:
+    std::vector<OperatingPoint> m_points;
+    std::vector<bool> m_disabled;
+    size_t m_index;
+    GovernorOptions m_options;
+
+    LatencyWindow m_latency;
+    Readings m_readings;
+    int m_calm = 0;
+    clock::time_point m_next;
+
+    // nearest enabled point from index in direction step, or index if none.
+    size_t neighbour(size_t index, int step) const;
+    void move_to(size_t index);
+
+    float read_celsius() const;
+    float read_frequency_ratio() const;
+};
@@ -0,0 +1,198 @@
+#include "InferEngine.h"
+#include "Postprocess.h"
+#include "TensorCapture.h"
+
+#include <cstring>
+#include <numeric>
+#include <iterator>
+
+using timer = std::chrono::high_resolution_clock;
+
+static float to_ms(timer::duration d) {
+    return std::chrono::duration<float, std::milli>(d).count();
+}
+
+int InferEngine::select_palm(float* rawBoxes, float* rawScores) {
+    const float* anchors = sharedAnchors();
+
+    // Apply sigmoid to confidence scores
+    sigmoid_score(rawScores);
+
+    // Decode boxes with pre-defined anchors
+    auto *decodedBoxes = rawBoxes;
+    for (auto i = 0; i < detclnum; ++i) {
+        const float* anchor = &anchors[i * 4];      // Each anchor has 4 values
+        float* decodedBox = &decodedBoxes[i * 18];  // Each decoded box also has 18 values
+
+        decodedBox[0] += anchor[0] * 192;           // dx + anchor_x * input size
+        decodedBox[1] += anchor[1] * 192;           // dy + anchor_y * input size
+    }
+
+    // Filter out boxes with confidence threshold
+    candidateDetect.clear();
+    filteredProbabilities.clear();
+    indices.clear();
+    for (auto i = 0; i < detclnum; ++i) {
+        if (rawScores[i] <= confidenceThreshold)
+            continue;
+        candidateDetect.emplace_back(decodedBoxes + i * 18);
+        filteredProbabilities.push_back(rawScores[i]);
+        indices.push_back(i);
+    }
+
+    // Perform Non-Maximum Suppression (NMS) - Pick the first detected hand by default
+    boxIds.clear();
+    boxIds = nonMaximumSuppression(candidateDetect, filteredProbabilities);
+
+    if (boxIds.empty())
+        return -1;
+
+    return indices[boxIds[0]];
+}
+
+const char* to_string(ModelVariant variant) {
+    switch (variant) {
+        case ModelVariant::Lite: return "lite";
+        case ModelVariant::Full: return "full";
+        default: return "adaptive";
+    }
+}
+
+bool InferEngine::do_infer(const cv::Mat& land_data, std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces) {
+    if (m_capture == nullptr)
+        return infer_frame(land_data, landmarks, faces);
+
+    m_capture->begin();
+    auto detected = infer_frame(land_data, landmarks, faces);
+    m_capture->end(detected, m_precise_landmarks);
+    return detected;
+}
+
+bool InferEngine::do_infer(const float* det_boxes, const float* det_scores, const cv::Mat& land_data,
+                           std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces) {
+    std::memcpy(m_det_boxes, det_boxes, detclnum * 18 * sizeof(float));
+    std::memcpy(m_det_scores, det_scores, detclnum * sizeof(float));
+    reset_tracking();
+
+    m_detections_ready = true;
+    auto detected = do_infer(land_data, landmarks, faces);
+    m_detections_ready = false;
+
+    return detected;
+}
+
+bool InferEngine::infer_frame(const cv::Mat& land_data, std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces) {
+    m_stages = {};
+
+    cv::Size originalSize(kHeight, kWidth);
+    cv::Size padding(detPadHeight, detPadWidth);
+    float scale = static_cast<float>(std::max(originalSize.width, originalSize.height)) / detInputSize;
+
+    // between detections the hand is cropped where the last landmarks were
+    bool tracked = m_tracking && ++m_since_detect < m_detect_interval;
+
+    auto begin = timer::now();
+    auto palm_end = begin;
+    std::vector<cv::Point2f> sourceTriangle;
+
+    if (tracked) {
+        sourceTriangle = m_track_triangle;
+    } else {
+        m_tracking = false;
+        m_since_detect = 0;
+        m_score = 0.0f;
+
+        if (!m_detections_ready && !invoke_detector())
+            return false;
+        palm_end = timer::now();
+        m_stages.detector = to_ms(palm_end - begin);
+
+        // before select_palm() decodes them in place
+        if (m_capture != nullptr)
+            m_capture->detector(m_det_boxes, m_det_scores);
+
+        // If at least one box is detected, proceed palm(hand) detection
+        auto palm = select_palm(m_det_boxes, m_det_scores);
+        if (palm < 0) {
+            m_stages.detector_post = to_ms(timer::now() - palm_end);
+            return false;
+        }
+
+        m_score = m_det_scores[palm];
+
+        BoundBox detect(m_det_boxes + palm * 18);
+        const float* anchor = sharedAnchors() + palm * 4;
+        cv::Point2f center_wo_offset(anchor[0] * 192, anchor[1] * 192);
+
+        // Extract details for the first detected hand
+        std::vector<cv::Point2f> keypoints;
+        std::tie(sourceTriangle, keypoints) = extractHandDetails(detect, center_wo_offset);
+
+        // If at least one hand is detected, proceed landmark detection
+        if (sourceTriangle.empty()) {
+            m_stages.detector_post = to_ms(timer::now() - palm_end);
+            return false;
+        }
+
+        faces.push_back(projectBoxToOriginal(detect, scale, padding));
+    }
+
+    // Compute affine transformation matrix
+    cv::Mat affineMatrix = computeAffineMatrix(sourceTriangle, scale);
+
+    // Hand landmark model inference
+    warpHandRegion(land_data, affineMatrix, m_land_input);
+
+    auto palm_post_end = timer::now();
+    m_stages.detector_post = to_ms(palm_post_end - palm_end);
+
+    if (!invoke_landmark())
+        return false;
+    auto landmark_end = timer::now();
+    m_stages.landmark = to_ms(landmark_end - palm_post_end);
+
+    if (m_capture != nullptr)
+        m_capture->landmark(m_land_input, m_land_output, m_land_presence);
+
+    if (tracked && m_land_presence != nullptr)
+        m_score = *m_land_presence;
+
+    // a tracked hand may have left the crop; detect again on the next frame
+    if (tracked && m_land_presence != nullptr && *m_land_presence < confidenceThreshold) {
+        m_tracking = false;
+        m_stages.landmark_post = to_ms(timer::now() - landmark_end);
+        return false;
+    }
+
+    // Extract landmarks
+    std::vector<std::array<float, 3>> joints = extractLandmarks(m_land_output);
+
+    // Pad affine matrix and compute inverse
+    cv::Mat paddedMatrix = cv::Mat::eye(3, 3, CV_32F);
+    affineMatrix.copyTo(paddedMatrix(cv::Rect(0, 0, 3, 2)));
+    cv::Mat inverseMatrix = paddedMatrix.inv();
+
+    projectLandmarksToOriginal(joints, inverseMatrix, padding, m_precise_landmarks);
+    landmarks.clear();
+    for (const auto& point : m_precise_landmarks)
+        landmarks.emplace_back(static_cast<int>(point.x), static_cast<int>(point.y));
+
+    if (m_detect_interval > 1) {
+        m_track_triangle = landmarksToTriangle(landmarks, scale, padding);
+        m_tracking = true;
+
+        if (tracked)
+            faces.push_back(cv::boundingRect(landmarks));
+    }
+
+    auto end = timer::now();
+    m_stages.landmark_post = to_ms(end - landmark_end);
+
+    auto total_time = (end - begin).count();
+    models_latencies[models_counter++ % 10] = total_time;
+    if (models_counter > 10){
+        models_average = std::accumulate(std::begin(models_latencies), std::end(models_latencies), int64_t(0)) / (10 * 1000000.0f);
+    }
+
+    return true;
+}
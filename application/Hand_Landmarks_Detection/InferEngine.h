@@ -1,21 +1,182 @@
 #pragma once
 
+#include "Defs.h"
+#include "nms.h"
+
 #include <opencv2/core.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
 #include <vector>
 #include <memory>
 
+struct XNNPackOptions {
+    int threads = kEngineThreads;
+    bool fp16 = kXNNPackFp16;             // allow fp16 inference on fp32 models
+    bool quantized = kXNNPackQuantized;   // run quantized operators in xnnpack
+    bool weight_cache = kXNNPackWeightCache;
+    std::vector<int> cores;               // pin the delegate's threads, empty for any core
+};
+
+// time spent in each stage of the last do_infer(), in ms.
+struct StageTimes {
+    float detector = 0.0f;
+    float detector_post = 0.0f;  // decode, nms and hand crop
+    float landmark = 0.0f;
+    float landmark_post = 0.0f;
+
+    float total() const { return detector + detector_post + landmark + landmark_post; }
+};
+
+// model size. full models are slower and more accurate; both take the same
+// inputs and produce the same outputs.
+enum class ModelVariant {
+    Lite,
+    Full,
+    Adaptive  // both loaded, chosen frame by frame, see ModelSelector.h
+};
+
+const char* to_string(ModelVariant variant);
+
+class TensorCapture;
+
+struct StartupStep {
+    std::string name;
+    float ms;
+};
+
 class InferEngine {
 public:
     virtual ~InferEngine() noexcept = default;
 
-    virtual bool do_infer(const cv::Mat& det_input, cv::Mat& land_input, std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces) = 0;
+    // run inference on the frame already written into det_input().
+    // land_input is the padded RGB frame the hand is cropped from. on
+    // detection the palm box is appended to faces.
+    virtual bool do_infer(const cv::Mat& land_input, std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces);
+
+    bool do_infer(const cv::Mat& det_input, cv::Mat& land_input, std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces) {
+        if (det_input.data != m_det_input.data)
+            det_input.copyTo(m_det_input);
+
+        return do_infer(land_input, landmarks, faces);
+    }
+
+    // same, on raw detector outputs computed elsewhere (e.g. by a
+    // BatchDetector) instead of invoking the detector. always detects,
+    // whatever the detection interval.
+    bool do_infer(const float* det_boxes, const float* det_scores, const cv::Mat& land_input,
+                  std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces);
+
+    // run a single model on whatever is in its bound input.
+    virtual bool invoke_detector() = 0;
+    virtual bool invoke_landmark() = 0;
+
+    // run both models on dummy inputs so lazy initialization and cold
+    // caches are paid before the first real frame.
+    bool warmup(int runs) {
+        m_det_input.setTo(cv::Scalar::all(0.5));
+        m_land_input.setTo(cv::Scalar::all(0.5));
+
+        for (auto i = 0; i < runs; ++i) {
+            if (!invoke_detector() || !invoke_landmark())
+                return false;
+        }
+
+        return true;
+    }
+
+    const StageTimes& last_stages() const { return m_stages; }
 
-    static std::unique_ptr<InferEngine> create_tflite_engine();
-    static std::unique_ptr<InferEngine> create_optimium_engine();
+    // landmarks of the last successful do_infer() before rounding to pixels.
+    const std::vector<cv::Point2f>& precise_landmarks() const { return m_precise_landmarks; }
+
+    // confidence behind the last do_infer(): the palm detector's score, or
+    // the hand presence on frames cropped from tracking. 0 if no palm.
+    float last_score() const { return m_score; }
+
+    // run the palm detector on every frames-th frame only and crop the hand
+    // from the previous landmarks in between. 1 detects on every frame.
+    void set_detection_interval(int frames) { m_detect_interval = std::max(1, frames); }
+    int detection_interval() const { return m_detect_interval; }
+
+    // time spent in each step of engine creation.
+    const std::vector<StartupStep>& startup_steps() const { return m_startup; }
+
+    // record the raw tensors of every do_infer() into capture, nullptr
+    // stops. only while no inference is in flight.
+    void set_capture(TensorCapture* capture) { m_capture = capture; }
+
+    static std::unique_ptr<InferEngine> create_tflite_engine(const XNNPackOptions& options = {},
+                                                             ModelVariant variant = ModelVariant::Lite);
+    static std::unique_ptr<InferEngine> create_optimium_engine(int threads = kEngineThreads, const std::vector<int>& cores = {},
+                                                               ModelVariant variant = ModelVariant::Lite);
+
+    // no models: each do_infer() replays the next record of a tensor
+    // capture through the post-processing. the frame passed in only feeds
+    // the hand crop, whose result is replaced by the captured one.
+    static std::unique_ptr<InferEngine> create_replay_engine(const std::string& capture_path);
+
+    // runs every frame on lite or full, whichever a ModelSelector picks.
+    // nullptr if either engine is. the two may be shared with other users,
+    // e.g. an EngineProvider's lite and full engines, as long as nothing
+    // runs them at the same time as this one.
+    static std::unique_ptr<InferEngine> create_adaptive_engine(std::shared_ptr<InferEngine> lite,
+                                                               std::shared_ptr<InferEngine> full);
     float average() const { return models_average;}
     int64_t models_latencies[10] {0, };
     int64_t models_counter = 0;
     float models_average = 0.0f;
 
-};
\ No newline at end of file
+    // views on engine owned tensor memory. resolved once at init and valid
+    // until the engine is destroyed, so callers can write inputs and read
+    // outputs in place. adaptive engines move them to the model chosen for
+    // the next frame after each do_infer(), so take them afresh per frame.
+    cv::Mat& det_input() { return m_det_input; }
+    float* det_boxes() const { return m_det_boxes; }
+    float* det_scores() const { return m_det_scores; }
+    cv::Mat& land_input() { return m_land_input; }
+    const float* land_output() const { return m_land_output; }
+    const float* land_presence() const { return m_land_presence; }
+
+protected:
+    std::vector<StartupStep> m_startup;
+    StageTimes m_stages;
+    std::vector<cv::Point2f> m_precise_landmarks;
+    float m_score = 0.0f;
+
+    // decode raw detector outputs in place and pick the best palm.
+    // returns its anchor index, or -1 if there is none.
+    int select_palm(float* boxes, float* scores);
+
+    // detect on the next frame whatever the detection interval.
+    void reset_tracking() { m_tracking = false; }
+
+    void record_step(std::string name, std::chrono::steady_clock::time_point begin) {
+        auto elapsed = std::chrono::steady_clock::now() - begin;
+        m_startup.push_back({std::move(name), std::chrono::duration<float, std::milli>(elapsed).count()});
+    }
+
+    cv::Mat m_det_input;                // detInputSize x detInputSize, CV_32FC3
+    float* m_det_boxes = nullptr;       // detclnum x 18
+    float* m_det_scores = nullptr;      // detclnum
+    cv::Mat m_land_input;               // kInputSize x kInputSize, CV_32FC3
+    const float* m_land_output = nullptr;
+    const float* m_land_presence = nullptr; // hand flag, nullptr if the model has none
+
+private:
+    TensorCapture* m_capture = nullptr;
+    bool m_detections_ready = false;  // the detector outputs are already filled in
+    std::atomic<int> m_detect_interval = 1;
+    int m_since_detect = 0;
+    bool m_tracking = false;
+    std::vector<cv::Point2f> m_track_triangle; // detector space, from the last landmarks
+
+    std::vector<BoundBox> candidateDetect;
+    std::vector<float> filteredProbabilities;
+    std::vector<int> indices;
+    std::vector<int> boxIds;
+
+    bool infer_frame(const cv::Mat& land_input, std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces);
+};
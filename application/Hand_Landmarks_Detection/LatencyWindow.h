@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Keeps the last capacity latency samples and answers percentile queries.
+class LatencyWindow final {
+public:
+    explicit LatencyWindow(size_t capacity = 256)
+        : m_samples(capacity) {}
+
+    void add(float ms) {
+        m_samples[m_count++ % m_samples.size()] = ms;
+    }
+
+    size_t size() const { return std::min(m_count, m_samples.size()); }
+
+    void clear() { m_count = 0; }
+
+    // p in [0, 100]. 0 if there is no sample.
+    float percentile(float p) const {
+        auto n = size();
+        if (n == 0)
+            return 0.0f;
+
+        m_sorted.assign(m_samples.begin(), m_samples.begin() + n);
+        auto k = static_cast<size_t>(p / 100.0f * (n - 1) + 0.5f);
+        std::nth_element(m_sorted.begin(), m_sorted.begin() + k, m_sorted.end());
+
+        return m_sorted[k];
+    }
+
+private:
+    std::vector<float> m_samples;
+    size_t m_count = 0;
+    mutable std::vector<float> m_sorted;
+};
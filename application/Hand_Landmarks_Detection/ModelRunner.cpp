@@ -1,5 +1,7 @@
 #include "ModelRunner.h"
 #include "Defs.h"
+#include "Preprocess.h"
+#include "Affinity.h"
 
 #include <opencv2/imgproc.hpp>
 #include <opencv2/opencv.hpp>
@@ -12,7 +14,7 @@
 using timer = std::chrono::high_resolution_clock;
 
 int ModelRunner::start() {
-    if (m_engine == nullptr) {
+    if (m_next_engine == nullptr) {
         std::cerr << "error: engine not set.\n";
         return 1;
     }
@@ -27,49 +29,102 @@ int ModelRunner::start() {
 }
 
 void ModelRunner::stop() {
-    m_run = false;
+    {
+        std::unique_lock lock(m_frame_lock);
+        m_run = false;
+    }
     m_wait.clear();
+    m_frame_cv.notify_one();
 
     if (m_runner.joinable())
         m_runner.join();
 }
 
-void ModelRunner::infer() {
-    m_wait.clear();
-}
+void ModelRunner::submit(const cv::Mat& frame, const FrameStamp& stamp) {
+    {
+        std::unique_lock lock(m_frame_lock);
+        frame.copyTo(m_pending);
+        m_pending_frame_stamp = stamp;
 
-void ModelRunner::update_data(const cv::Mat& frame) {
-    cv::cvtColor(frame, det_rgb_converted, cv::COLOR_BGR2RGB);
-    cv::copyMakeBorder(det_rgb_converted, m_input_data, detPadHeight, detPadHeight, detPadWidth, detPadWidth, cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0));
-    cv::resize(m_input_data, det_resized, cv::Size(detInputSize, detInputSize));
-    det_resized.convertTo(det_input_data, CV_32F, 1.0 / 255.0);
+        if (m_has_pending)
+            m_replaced += 1;
+        m_has_pending = true;
+
+        // mark busy before waking the worker.
+        m_running = true;
+    }
+
+    m_wait.clear();
+    m_frame_cv.notify_one();
 }
 
 void ModelRunner::do_infer() {
+    pin_current_thread(m_cores);
+
     while (m_run) {
-        while (m_wait.test_and_set())
-            ; // busy wait
+        if (m_spin) {
+            while (m_wait.test_and_set())
+                ; // busy wait
+        }
 
-        if (!m_run) break;
+        ResultStamp stamp;
+        {
+            std::unique_lock lock(m_frame_lock);
+            if (!m_spin)
+                m_frame_cv.wait(lock, [this] { return m_has_pending || !m_run; });
 
-        m_running = true;
+            if (!m_run) break;
+            if (!m_has_pending)
+                continue;
+
+            cv::swap(m_pending, m_frame);
+            stamp.frame = m_pending_frame_stamp;
+            m_has_pending = false;
+        }
+
+        // frame boundary: apply a pending engine switch.
+        if (auto requested = m_requested_epoch.load(); requested != m_epoch) {
+            m_engine = m_next_engine.load();
+            m_epoch = requested;
+        }
+
+        auto* engine = m_engine.load();
+
+        // write straight into the detector input tensor.
+        preprocessFrame(m_frame, det_rgb_converted, det_resized, m_input_data, engine->det_input());
+        stamp.preprocessed = FrameStamp::clock::now();
 
         auto& next_landmark = m_landmarks[m_switch ? 1 : 0];
+        auto& next_stamp = m_stamps[m_switch ? 1 : 0];
         next_landmark.clear();
         m_faces.clear();
 
         auto begin = timer::now();
 
-        detected = m_engine->do_infer(det_input_data, m_input_data, next_landmark, m_faces);
+        detected = engine->do_infer(m_input_data, next_landmark, m_faces);
         auto end = timer::now();
 
+        next_stamp = stamp;
+        next_stamp.inferred = FrameStamp::clock::now();
+
+        if (m_listener)
+            m_listener(next_stamp, detected, m_faces, *engine);
+
         m_latencies[m_counter++ % 10]  = (end - begin).count();
         if (m_counter > 10) {
             m_average = std::accumulate(std::begin(m_latencies), std::end(m_latencies), int64_t(0)) / (10 * 1000000.0f);
         }
 
+        {
+            std::unique_lock lock(m_stats_lock);
+            m_window.add((end - begin).count() / 1000000.0f);
+        }
+
         m_switch = !m_switch;
-        m_running = false;
 
+        // stay busy if a newer frame arrived meanwhile; its submit() has
+        // already woken us up again.
+        std::unique_lock lock(m_frame_lock);
+        m_running = m_has_pending;
     }
 }
@@ -2,10 +2,16 @@
 
 #include "InferEngine.h"
 #include "Defs.h"
+#include "MotionGate.h"
+#include "LatencyWindow.h"
+#include "FrameStamp.h"
 
 #include <opencv2/core.hpp>
 
 #include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -13,43 +19,114 @@ class ModelRunner final {
 public:
     ~ModelRunner() noexcept { stop(); }
 
-    void set_engine(InferEngine& engine) { m_engine = &engine; }
+    // request an engine switch. the swap is applied at the next frame
+    // boundary, never while an inference is in flight.
+    void set_engine(InferEngine& engine) {
+        m_next_engine = &engine;
+        m_requested_epoch += 1;
+        m_gate.reset();
+    }
+
+    // engine used by the current or last inference.
+    InferEngine* engine() const { return m_engine; }
+
+    // true until a requested switch has been applied.
+    bool switching() const { return m_epoch != m_requested_epoch; }
+
+    // skip inference on frames that barely differ from the last inferred
+    // one. threshold is the mean absolute luma difference, 0 disables.
+    void set_motion_gate(float threshold, int max_skip) { m_gate.configure(threshold, max_skip); }
 
+    // false if frame is static enough to reuse the previous result.
+    bool needs_infer(const cv::Mat& frame) { return m_gate.check(frame); }
+
+    int64_t skipped() const { return m_gate.skipped(); }
+
+    // true while a submitted frame is waiting or being inferred.
     bool is_running() const { return m_running; }
 
     int start();
 
     void stop();
 
-    void infer();
+    // hand over a frame for inference. never blocks: the frame is copied
+    // and replaces any frame the worker has not picked up yet, so only
+    // frames that are actually inferred get preprocessed. stamp is carried
+    // into result_stamp().
+    void submit(const cv::Mat& frame, const FrameStamp& stamp = {});
 
-    void update_data(const cv::Mat& frame);
+    // submitted frames replaced by a newer one before inference.
+    int64_t replaced() const { return m_replaced; }
 
     const std::vector<cv::Point>& landmarks() const {
         return m_landmarks[m_switch ? 0 : 1];
     }
 
+    // which frame landmarks() was computed on, and when.
+    const ResultStamp& result_stamp() const {
+        return m_stamps[m_switch ? 0 : 1];
+    }
+
     float average() const { return m_average; }
 
+    // p-th percentile of recent inference latencies in ms.
+    float latency(float p) const {
+        std::unique_lock lock(m_stats_lock);
+        return m_window.percentile(p);
+    }
+
+    // pin the worker thread. must be called before start().
+    void set_affinity(std::vector<int> cores) { m_cores = std::move(cores); }
+
+    // called on the worker with every result, e.g. to publish it. engine
+    // is the one that inferred it; its precise landmarks, stages and score
+    // describe the result. only valid during the call. must be set before
+    // start().
+    using Listener = std::function<void(const ResultStamp& stamp, bool detected, const std::vector<cv::Rect>& boxes,
+                                        const InferEngine& engine)>;
+    void set_listener(Listener listener) { m_listener = std::move(listener); }
+
+    // busy-wait for frames instead of sleeping. lowest wake-up latency,
+    // but burns a core while idle. must be called before start().
+    void set_spin(bool spin) { m_spin = spin; }
+
 // private:
     void do_infer();
 
-    InferEngine* m_engine = nullptr;
+    // m_engine is only written by the worker at a frame boundary, before
+    // preprocessing the next frame.
+    std::atomic<InferEngine*> m_engine = nullptr;
+    std::atomic<InferEngine*> m_next_engine = nullptr;
+    std::atomic<uint64_t> m_requested_epoch = 0;
+    std::atomic<uint64_t> m_epoch = 0;
+    MotionGate m_gate;
+
+    // latest submitted frame, not picked up yet
+    std::mutex m_frame_lock;
+    cv::Mat m_pending;
+    FrameStamp m_pending_frame_stamp;
+    bool m_has_pending = false;
+    std::atomic<int64_t> m_replaced = 0;
+
+    // frame being inferred, worker only
+    cv::Mat m_frame;
 
     // palm detection
     cv::Mat det_rgb_converted;
     cv::Mat det_padded;
     cv::Mat det_resized;
-    cv::Mat det_input_data;
 
     // face landmark
     cv::Mat m_input_data;
     std::vector<cv::Point> m_landmarks[2];
+    ResultStamp m_stamps[2];
     std::vector<cv::Rect> m_faces;
     bool m_switch = false;
 
     std::thread m_runner;
     std::atomic_flag m_wait = ATOMIC_FLAG_INIT;
+    std::condition_variable m_frame_cv;
+    bool m_spin = true;
     std::atomic<bool> m_run = true;
     std::atomic<bool> m_running = false;
 
@@ -57,5 +134,10 @@ public:
     int64_t m_counter = 0;
     float m_average = 0.0f;
 
+    mutable std::mutex m_stats_lock;
+    LatencyWindow m_window;
+    std::vector<int> m_cores;
+    Listener m_listener;
+
     bool detected = true;
 };
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "ModelSelector.h"
+
+static float smooth(float average, float sample) {
+    return (average > 0.0f) ? average + kAdaptiveSmoothing * (sample - average) : sample;
+}
+
+void ModelSelector::add(int model, ModelVariant variant, float ms) {
+    // tracking frames skip the detector
+    if (ms <= 0.0f)
+        return;
+
+    if (variant == ModelVariant::Lite)
+        m_lite_ms[model] = smooth(m_lite_ms[model], ms);
+    else if (m_lite_ms[model] > 0.0f)
+        m_full_ratio[model] = m_full_ratio[model] + kAdaptiveSmoothing * (ms / m_lite_ms[model] - m_full_ratio[model]);
+}
+
+float ModelSelector::expected_ms(ModelVariant variant) const {
+    if (m_lite_ms[Detector] <= 0.0f || m_lite_ms[Landmark] <= 0.0f)
+        return 0.0f;
+
+    if (variant != ModelVariant::Full)
+        return m_lite_ms[Detector] + m_lite_ms[Landmark];
+
+    return m_lite_ms[Detector] * m_full_ratio[Detector] + m_lite_ms[Landmark] * m_full_ratio[Landmark];
+}
+
+ModelVariant ModelSelector::update(ModelVariant variant, const StageTimes& stages, float hand) {
+    add(Detector, variant, stages.detector);
+    add(Landmark, variant, stages.landmark);
+
+    auto full_ms = expected_ms(ModelVariant::Full);
+
+    if (m_current == ModelVariant::Full) {
+        if (full_ms > m_options.budget_ms * m_options.down_headroom || hand > m_options.large_hand) {
+            m_current = ModelVariant::Lite;
+            m_calm = 0;
+        }
+        return m_current;
+    }
+
+    // no hand counts as a far one, which is what full models find better
+    bool favour = full_ms > 0.0f && full_ms <= m_options.budget_ms * m_options.up_headroom &&
+                  hand < m_options.small_hand;
+
+    m_calm = favour ? m_calm + 1 : 0;
+    if (m_calm >= m_options.hold) {
+        m_current = ModelVariant::Full;
+        m_calm = 0;
+    }
+
+    return m_current;
+}
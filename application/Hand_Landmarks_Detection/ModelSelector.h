@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Defs.h"
+#include "InferEngine.h"
+
+struct SelectorOptions {
+    float budget_ms = kAdaptiveBudgetMS;
+    float up_headroom = kAdaptiveUpHeadroom;
+    float down_headroom = kAdaptiveDownHeadroom;
+    float small_hand = kAdaptiveSmallHand;
+    float large_hand = kAdaptiveLargeHand;
+    int hold = kAdaptiveHold;
+};
+
+// Chooses between lite and full models frame by frame.
+//
+// Full models pay off on small, far hands, which lite models lose first,
+// so they are chosen for those as long as a frame with both full models
+// is expected to fit well within the budget. Any frame over the down
+// headroom or with a large hand goes back to lite at once. Moving up
+// needs hold frames in a row in favour of full, and the gaps between the
+// up and down thresholds keep the choice from flapping.
+//
+// Full model times are tracked as a ratio over the lite ones, so the
+// estimate follows the board's clock while lite models run.
+class ModelSelector final {
+public:
+    explicit ModelSelector(SelectorOptions options = {}) : m_options(options) {}
+
+    // the last frame ran variant and took stages. hand is the longer side
+    // of the hand's box over the frame height, 0 if there was none.
+    // returns the variant to run the next frame with.
+    ModelVariant update(ModelVariant variant, const StageTimes& stages, float hand);
+
+    ModelVariant current() const { return m_current; }
+
+    // time a frame that runs both models of variant is expected to take,
+    // 0 until lite models have run.
+    float expected_ms(ModelVariant variant) const;
+
+private:
+    enum { Detector, Landmark };
+
+    SelectorOptions m_options;
+    ModelVariant m_current = ModelVariant::Lite;
+    int m_calm = 0;
+
+    float m_lite_ms[2] = {0.0f, 0.0f};
+    float m_full_ratio[2] = {kAdaptiveFullCost, kAdaptiveFullCost};
+
+    void add(int model, ModelVariant variant, float ms);
+};
@@ -0,0 +1,61 @@
+#include "MotionGate.h"
+
+#include <opencv2/imgproc.hpp>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+uint64_t sad_u8(const uint8_t* a, const uint8_t* b, size_t size) {
+    uint64_t sum = 0;
+    size_t i = 0;
+
+#if defined(__aarch64__)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        acc = vpadalq_u16(acc, vpaddlq_u8(diff));
+    }
+    sum = vaddvq_u32(acc);
+#elif defined(__x86_64__)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    sum = _mm_cvtsi128_si64(acc) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+#endif
+
+    for (; i < size; ++i)
+        sum += (a[i] > b[i]) ? (a[i] - b[i]) : (b[i] - a[i]);
+
+    return sum;
+}
+
+bool MotionGate::check(const cv::Mat& frame) {
+    if (!enabled())
+        return true;
+
+    cv::resize(frame, m_small, cv::Size(kGateWidth, kGateHeight), 0, 0, cv::INTER_AREA);
+    cv::cvtColor(m_small, m_luma, cv::COLOR_BGR2GRAY);
+
+    if (m_reference.empty()) {
+        m_difference = 0.0f;
+    } else {
+        auto size = m_luma.total();
+        m_difference = sad_u8(m_luma.data, m_reference.data, size) / static_cast<float>(size);
+
+        if (m_difference < m_threshold && m_skip < m_max_skip) {
+            ++m_skip;
+            ++m_skipped;
+            return false;
+        }
+    }
+
+    m_skip = 0;
+    std::swap(m_luma, m_reference);
+    return true;
+}
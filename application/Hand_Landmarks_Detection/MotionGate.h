@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Defs.h"
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// sum of absolute differences between two byte buffers.
+uint64_t sad_u8(const uint8_t* a, const uint8_t* b, size_t size);
+
+// Cheap frame-change detector. Each frame is shrunk to a small luma image
+// and compared against the last frame that was let through.
+class MotionGate final {
+public:
+    void configure(float threshold, int max_skip) {
+        m_threshold = threshold;
+        m_max_skip = max_skip;
+        reset();
+    }
+
+    bool enabled() const { return m_threshold > 0.0f; }
+
+    // returns true if frame should be inferred. accepted frames become the
+    // new reference.
+    bool check(const cv::Mat& frame);
+
+    // force the next check() to pass.
+    void reset() { m_reference.release(); }
+
+    float difference() const { return m_difference; }
+    int64_t skipped() const { return m_skipped; }
+
+private:
+    float m_threshold = 0.0f;
+    int m_max_skip = 0;
+    int m_skip = 0;
+    int64_t m_skipped = 0;
+    float m_difference = 0.0f;
+
+    cv::Mat m_small;
+    cv::Mat m_luma;
+    cv::Mat m_reference;
+};
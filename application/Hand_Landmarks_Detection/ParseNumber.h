@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+// parse a whole number for a command line option. false on anything else,
+// including trailing characters and values out of range for T.
+template <typename T>
+bool parse_number(const std::string& text, T& value) {
+    const auto* end = text.data() + text.size();
+    auto [ptr, error] = std::from_chars(text.data(), end, value);
+    return !text.empty() && error == std::errc() && ptr == end;
+}
+
+// same for a finite decimal. from_chars for floats needs a newer libstdc++
+// than the boards ship.
+inline bool parse_number(const std::string& text, float& value) {
+    char* end = nullptr;
+    errno = 0;
+    auto parsed = std::strtof(text.c_str(), &end);
+    if (text.empty() || end != text.c_str() + text.size() || errno == ERANGE || !std::isfinite(parsed))
+        return false;
+
+    value = parsed;
+    return true;
+}
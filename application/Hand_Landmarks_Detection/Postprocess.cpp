@@ -1,6 +1,8 @@
 #include "Defs.h"
 #include "Postprocess.h"
 
+#include <memory>
+
 // Load anchors from anchors.csv
 float* loadAnchors(const std::string& filePath) {
     std::ifstream file(filePath);
@@ -40,6 +42,11 @@ float* loadAnchors(const std::string& filePath) {
     return anchors;
 }
 
+const float* sharedAnchors() {
+    static const std::unique_ptr<float[]> anchors(loadAnchors("anchors.csv"));
+    return anchors.get();
+}
+
 void sigmoid_score(float* raw_data){
     for(int i=0; i < detclnum; i++){
         raw_data[i] = 1.0f / (1.0f + std::exp(-raw_data[i]));
@@ -117,6 +124,27 @@ std::tuple<std::vector<cv::Point2f>, std::vector<cv::Point2f>> extractHandDetail
     return {sourceTriangle, keypoints};
 }
 
+std::vector<cv::Point2f> landmarksToTriangle(
+    const std::vector<cv::Point>& landmarks,
+    float scale,
+    const cv::Size& padding
+) {
+    // wrist and finger bases span the palm the detector would have boxed
+    constexpr int palm[] = {0, 1, 5, 9, 13, 17};
+
+    std::vector<cv::Point2f> points;
+    for (auto i : palm) {
+        // back to detector input coordinates
+        points.emplace_back((landmarks[i].x + padding.height) / scale, (landmarks[i].y + padding.width) / scale);
+    }
+
+    auto bounds = cv::boundingRect(points);
+    float side = std::max(bounds.width, bounds.height) * boxEnlarge;
+
+    // wrist and middle finger base, as keypoints 0 and 2 of the detector
+    return getTriangle(points[0], points[3], side, boxShift);
+}
+
 cv::Mat computeAffineMatrix(
     const std::vector<cv::Point2f>& sourceTriangle, 
     float scale
@@ -158,6 +186,20 @@ std::vector<std::array<float, 3>> extractLandmarks(const float* outraw) {
     return keypoints;
 }
 
+cv::Rect projectBoxToOriginal(
+    const BoundBox& detect,
+    float scale,
+    const cv::Size& padding
+) {
+    // same padding convention as projectLandmarksToOriginal
+    float w = detect[2] * scale;
+    float h = detect[3] * scale;
+    float x = detect[0] * scale - w / 2.0f - padding.height;
+    float y = detect[1] * scale - h / 2.0f - padding.width;
+
+    return cv::Rect(cvRound(x), cvRound(y), cvRound(w), cvRound(h));
+}
+
 cv::Mat padAffineMatrix(const cv::Mat& affineMatrix) {
     cv::Mat paddedMatrix = cv::Mat::eye(3, 3, CV_32F); // Create 3x3 identity matrix
     affineMatrix.copyTo(paddedMatrix(cv::Rect(0, 0, 3, 2))); // Copy affine matrix into top rows
@@ -168,12 +210,13 @@ cv::Mat computeInverseMatrix(const cv::Mat& paddedMatrix) {
     return paddedMatrix.inv(); // Compute inverse matrix
 }
 
-std::vector<cv::Point> projectLandmarksToOriginal(
+void projectLandmarksToOriginal(
     const std::vector<std::array<float, 3>>& keypoints,
     const cv::Mat& inverseMatrix,
-    const cv::Size& padding
+    const cv::Size& padding,
+    std::vector<cv::Point2f>& projectedKeypoints
 ) {
-    std::vector<cv::Point> projectedKeypoints;
+    projectedKeypoints.clear();
 
     auto t = inverseMatrix.t();
 
@@ -186,6 +229,20 @@ std::vector<cv::Point> projectLandmarksToOriginal(
 
         projectedKeypoints.emplace_back(x, y);
     }
+}
+
+std::vector<cv::Point> projectLandmarksToOriginal(
+    const std::vector<std::array<float, 3>>& keypoints,
+    const cv::Mat& inverseMatrix,
+    const cv::Size& padding
+) {
+    std::vector<cv::Point2f> precise;
+    projectLandmarksToOriginal(keypoints, inverseMatrix, padding, precise);
+
+    // truncated, as before the float overload existed
+    std::vector<cv::Point> projectedKeypoints;
+    for (const auto& point : precise)
+        projectedKeypoints.emplace_back(static_cast<int>(point.x), static_cast<int>(point.y));
 
     return projectedKeypoints;
 }
@@ -14,6 +14,10 @@ void decode_box(float* raw_data, float* anchors);
 
 float* loadAnchors(const std::string& filePath);
 
+// Anchors of anchors.csv, loaded once and shared by all engines.
+// nullptr if the file could not be loaded.
+const float* sharedAnchors();
+
 void sigmoid_score(float* raw_data);
 
 void decodeBoundingBoxes(
@@ -29,6 +33,14 @@ std::vector<cv::Point2f> getTriangle(
     float boxShift
 );
 
+// Transformation triangle of a hand from its landmarks in original frame
+// coordinates, to crop the next frame without running the palm detector
+std::vector<cv::Point2f> landmarksToTriangle(
+    const std::vector<cv::Point>& landmarks,
+    float scale,
+    const cv::Size& padding
+);
+
 std::tuple<std::vector<cv::Point2f>, std::vector<cv::Point2f>> extractHandDetails(
     const BoundBox& detect,
     cv::Point2f offset
@@ -47,10 +59,25 @@ void warpHandRegion(
 
 std::vector<std::array<float, 3>> extractLandmarks(const float* outraw);
 
+// Palm box of a decoded detection in original frame coordinates
+cv::Rect projectBoxToOriginal(
+    const BoundBox& detect,
+    float scale,
+    const cv::Size& padding
+);
+
 cv::Mat padAffineMatrix(const cv::Mat& affineMatrix);
 
 cv::Mat computeInverseMatrix(const cv::Mat& paddedMatrix);
 
+// Same, without rounding to whole pixels
+void projectLandmarksToOriginal(
+    const std::vector<std::array<float, 3>>& keypoints,
+    const cv::Mat& inverseMatrix,
+    const cv::Size& padding,
+    std::vector<cv::Point2f>& projectedKeypoints
+);
+
 std::vector<cv::Point> projectLandmarksToOriginal(
     const std::vector<std::array<float, 3>>& keypoints,
     const cv::Mat& inverseMatrix,
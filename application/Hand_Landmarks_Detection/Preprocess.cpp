@@ -0,0 +1,17 @@
+#include "Defs.h"
+#include "Preprocess.h"
+
+#include <opencv2/imgproc.hpp>
+
+void preprocessFrame(
+    const cv::Mat& frame,
+    cv::Mat& rgb,
+    cv::Mat& resized,
+    cv::Mat& padded,
+    cv::Mat& det_input
+) {
+    cv::cvtColor(frame, rgb, cv::COLOR_BGR2RGB);
+    cv::copyMakeBorder(rgb, padded, detPadHeight, detPadHeight, detPadWidth, detPadWidth, cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0));
+    cv::resize(padded, resized, cv::Size(detInputSize, detInputSize));
+    resized.convertTo(det_input, CV_32F, 1.0 / 255.0);
+}
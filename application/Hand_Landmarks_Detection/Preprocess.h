@@ -0,0 +1,16 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+// Convert a BGR camera frame into detector input.
+//  - padded: RGB frame padded to a square, used to crop the hand region.
+//  - det_input: detInputSize x detInputSize CV_32FC3 in [0, 1]. written in
+//    place, so it can be the engine's input tensor.
+// rgb and resized are scratch buffers kept by the caller across frames.
+void preprocessFrame(
+    const cv::Mat& frame,
+    cv::Mat& rgb,
+    cv::Mat& resized,
+    cv::Mat& padded,
+    cv::Mat& det_input
+);
@@ -5,7 +5,10 @@
 #include <iostream>
 
 int Recorder::start(cv::Size size) {
-    if (!m_writer.open(m_output, kMJPG, kFPS, size)) {
+    if (FrameFileWriter::is_frame_file(m_output)) {
+        if (m_raw.open(m_output, size))
+            return -1;
+    } else if (!m_writer.open(m_output, kMJPG, kFPS, size)) {
         std::cerr << "error: failed to open VideoWriter.\n";
         return -1;
     }
@@ -30,6 +33,7 @@ void Recorder::done() {
         m_thread.join();
 
     m_writer.release();
+    m_raw.close();
 }
 
 void Recorder::do_write() {
@@ -50,7 +54,10 @@ void Recorder::do_write() {
                 m_queue.pop();
             }
 
-            m_writer << frame;
+            if (m_raw.is_open())
+                m_raw.append(frame);
+            else
+                m_writer << frame;
         }
 
         if (!m_recording && m_queue.empty())
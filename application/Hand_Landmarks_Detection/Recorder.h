@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Defs.h"
+#include "FrameFile.h"
 
 #include <opencv2/core.hpp>
 #include <opencv2/videoio.hpp>
@@ -12,6 +13,8 @@
 #include <mutex>
 #include <queue>
 
+// Writes frames on its own thread, as MJPG video or, if output ends in
+// .frames, as a raw frame file.
 class Recorder final {
 public:
     explicit Recorder(std::string output)
@@ -27,6 +30,7 @@ private:
     std::string m_output;
 
     cv::VideoWriter m_writer;
+    FrameFileWriter m_raw;
     std::thread m_thread;
     std::condition_variable m_cv;
     std::mutex m_lock;
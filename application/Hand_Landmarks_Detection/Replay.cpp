@@ -0,0 +1,95 @@
+#include "InferEngine.h"
+#include "TensorCapture.h"
+
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+// Replays a tensor capture in place of the models. Everything between the
+// model invocations runs as it would live, on the captured outputs, so
+// its results match the capturing engine bit for bit.
+class ReplayInferEngine final : public InferEngine {
+public:
+    bool init(const std::string& path) {
+        if (!m_reader.open(path)) {
+            std::cerr << "error: " << path << " is not a tensor capture of this build.\n";
+            return false;
+        }
+
+        // select_palm() decodes in place, so outputs are copied out of the
+        // read only mapping into engine owned tensors.
+        m_boxes.resize(kCaptureBoxFloats);
+        m_scores.resize(kCaptureScoreFloats);
+        m_output.resize(kCaptureLandmarkFloats);
+
+        m_det_input = cv::Mat(detInputSize, detInputSize, CV_32FC3, cv::Scalar::all(0));
+        m_det_boxes = m_boxes.data();
+        m_det_scores = m_scores.data();
+        m_land_input = cv::Mat(kInputSize, kInputSize, CV_32FC3, cv::Scalar::all(0));
+        m_land_output = m_output.data();
+
+        // the capture decides when the detector runs, not an interval.
+        set_detection_interval(std::numeric_limits<int>::max());
+        return true;
+    }
+
+    bool do_infer(const cv::Mat& land_data, std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces) override {
+        if (m_next >= m_reader.size())
+            return false;
+
+        m_record = m_reader.at(m_next++);
+        if (m_record.record->flags & kCaptureDetector)
+            reset_tracking();
+
+        m_land_presence = (m_record.record->flags & kCapturePresence) ? &m_record.record->presence : nullptr;
+
+        return InferEngine::do_infer(land_data, landmarks, faces);
+    }
+
+    bool invoke_detector() override {
+        // nothing to replay outside of do_infer(), e.g. on warmup
+        if (m_record.record == nullptr)
+            return true;
+
+        if (!(m_record.record->flags & kCaptureDetector)) {
+            std::cerr << "error: capture record " << m_record.record->index << " has no detector outputs.\n";
+            return false;
+        }
+
+        std::memcpy(m_det_boxes, m_record.boxes, kCaptureBoxFloats * sizeof(float));
+        std::memcpy(m_det_scores, m_record.scores, kCaptureScoreFloats * sizeof(float));
+        return true;
+    }
+
+    bool invoke_landmark() override {
+        if (m_record.record == nullptr)
+            return true;
+
+        if (!(m_record.record->flags & kCaptureLandmark)) {
+            std::cerr << "error: capture record " << m_record.record->index << " has no landmark outputs.\n";
+            return false;
+        }
+
+        // the crop the model saw, for whoever inspects land_input()
+        std::memcpy(m_land_input.data, m_record.input, kCaptureInputFloats * sizeof(float));
+        std::memcpy(m_output.data(), m_record.output, kCaptureLandmarkFloats * sizeof(float));
+        return true;
+    }
+
+private:
+    CaptureReader m_reader;
+    CaptureReader::View m_record{};
+    size_t m_next = 0;
+
+    std::vector<float> m_boxes;
+    std::vector<float> m_scores;
+    std::vector<float> m_output;
+};
+
+std::unique_ptr<InferEngine> InferEngine::create_replay_engine(const std::string& capture_path) {
+    auto engine = std::make_unique<ReplayInferEngine>();
+    if (!engine->init(capture_path))
+        return nullptr;
+
+    return engine;
+}
@@ -0,0 +1,106 @@
+#include "ResultPublisher.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+static int64_t to_ns(FrameStamp::clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+int ResultPublisher::open() {
+    close();
+
+    // a ring left behind by a crashed run may have another capacity.
+    shm_unlink(m_name.c_str());
+
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "error: failed to create shared memory " << m_name << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    auto size = result_ring::mapping_size(m_capacity);
+    if (ftruncate(fd, size) < 0) {
+        std::cerr << "error: failed to size shared memory " << m_name << ": " << strerror(errno) << "\n";
+        ::close(fd);
+        shm_unlink(m_name.c_str());
+        return 1;
+    }
+
+    auto* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "error: failed to map shared memory " << m_name << ": " << strerror(errno) << "\n";
+        shm_unlink(m_name.c_str());
+        return 1;
+    }
+
+    // ftruncate zero fills, so every slot starts at sequence 0.
+    m_header = static_cast<result_ring::Header*>(memory);
+    m_size = size;
+    m_header->capacity = m_capacity;
+    m_header->slot_size = sizeof(result_ring::Slot);
+    m_header->version = result_ring::kVersion;
+
+    // readers check the magic last.
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = result_ring::kMagic;
+
+    return 0;
+}
+
+void ResultPublisher::close() {
+    if (m_header == nullptr)
+        return;
+
+    munmap(m_header, m_size);
+    shm_unlink(m_name.c_str());
+    m_header = nullptr;
+    m_size = 0;
+}
+
+void ResultPublisher::publish(const ResultStamp& stamp, bool detected, const std::vector<cv::Rect>& boxes,
+                              const std::vector<cv::Point2f>& landmarks) {
+    if (m_header == nullptr)
+        return;
+
+    auto n = m_header->published.load(std::memory_order_relaxed);
+    auto& slot = result_ring::slots(m_header)[n % m_capacity];
+
+    slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // written in place; the slot is the only copy.
+    auto& result = slot.result;
+    result.frame = stamp.frame.sequence;
+    result.captured_ns = to_ns(stamp.frame.captured);
+    result.preprocessed_ns = to_ns(stamp.preprocessed);
+    result.inferred_ns = to_ns(stamp.inferred);
+    result.detected = detected;
+
+    result.box_count = std::min<uint32_t>(boxes.size(), result_ring::kMaxBoxes);
+    for (uint32_t i = 0; i < result.box_count; ++i) {
+        result.boxes[i][0] = boxes[i].x;
+        result.boxes[i][1] = boxes[i].y;
+        result.boxes[i][2] = boxes[i].width;
+        result.boxes[i][3] = boxes[i].height;
+    }
+
+    if (detected) {
+        auto count = std::min<size_t>(landmarks.size(), result_ring::kLandmarks);
+        for (size_t i = 0; i < count; ++i) {
+            result.landmarks[i][0] = landmarks[i].x;
+            result.landmarks[i][1] = landmarks[i].y;
+        }
+    }
+
+    slot.sequence.store(2 * n + 2, std::memory_order_release);
+    m_header->published.store(n + 1, std::memory_order_release);
+
+    // bump before checking for waiters; see Reader::wait().
+    m_header->futex.fetch_add(1, std::memory_order_acq_rel);
+    if (m_header->waiters.load(std::memory_order_acquire) > 0)
+        result_ring::futex(&m_header->futex, FUTEX_WAKE, INT_MAX, nullptr);
+}
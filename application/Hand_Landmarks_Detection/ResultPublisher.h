@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Defs.h"
+#include "ResultRing.h"
+#include "FrameStamp.h"
+
+#include <opencv2/core.hpp>
+
+#include <string>
+#include <vector>
+
+// Writes results into a POSIX shared memory ring for local consumers,
+// which attach with result_ring::Reader from ResultRing.h.
+//
+// Single producer: publish() must only be called from one thread at a
+// time. Readers never block it.
+class ResultPublisher final {
+public:
+    explicit ResultPublisher(std::string name, uint32_t capacity = kResultRingCapacity)
+        : m_name(std::move(name)), m_capacity(capacity) {}
+
+    ResultPublisher(const ResultPublisher&) = delete;
+    ResultPublisher& operator=(const ResultPublisher&) = delete;
+
+    // removes the ring; attached readers keep their mapping but see no
+    // more results.
+    ~ResultPublisher() noexcept { close(); }
+
+    // create the ring, replacing a stale one of the same name.
+    int open();
+    void close();
+
+    const std::string& name() const { return m_name; }
+
+    // landmarks are only published when detected.
+    void publish(const ResultStamp& stamp, bool detected, const std::vector<cv::Rect>& boxes,
+                 const std::vector<cv::Point2f>& landmarks);
+
+private:
+    std::string m_name;
+    uint32_t m_capacity;
+
+    result_ring::Header* m_header = nullptr;
+    size_t m_size = 0;
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+// Shared memory layout of published results, and a reader for it.
+//
+// Header only and free of OpenCV and the engines, so consumers only need
+// this file:
+//
+//   result_ring::Reader reader;
+//   if (!reader.open("/rpi-demo-results"))
+//       return 1;
+//
+//   result_ring::Result result;
+//   while (reader.wait(100)) {
+//       while (reader.poll(result) == result_ring::Reader::Status::Ok)
+//           use(result);
+//   }
+//
+// One producer writes, any number of readers follow it at their own pace.
+// A slot is guarded by a sequence number instead of a lock, so a slow
+// reader never blocks the producer; it is told it fell behind and skips to
+// the oldest result still in the ring. Timestamps are steady_clock, which
+// is CLOCK_MONOTONIC on Linux.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace result_ring {
+
+constexpr uint32_t kMagic = 0x484e5247;
+constexpr uint32_t kVersion = 1;
+constexpr int kMaxBoxes = 4;
+constexpr int kLandmarks = 21;
+
+// one inference result. plain data, copied out of the ring as is.
+struct Result {
+    int64_t frame;            // capture sequence of the frame, -1 if unstamped
+    int64_t captured_ns;      // steady_clock nanoseconds
+    int64_t preprocessed_ns;
+    int64_t inferred_ns;
+    uint32_t detected;        // landmarks are valid
+    uint32_t box_count;
+    int32_t boxes[kMaxBoxes][4];       // x, y, width, height in frame pixels
+    float landmarks[kLandmarks][2];    // x, y in frame pixels
+};
+
+struct Slot {
+    // 2n + 1 while the n-th result is written, 2n + 2 once it is complete.
+    std::atomic<uint64_t> sequence;
+    Result result;
+};
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t slot_size;
+
+    alignas(64) std::atomic<uint64_t> published; // results written so far
+    std::atomic<uint32_t> futex;   // bumped on every result, readers wait on it
+    std::atomic<uint32_t> waiters; // readers blocked in wait()
+};
+
+inline size_t mapping_size(uint32_t capacity) {
+    return sizeof(Header) + sizeof(Slot) * capacity;
+}
+
+inline Slot* slots(Header* header) {
+    return reinterpret_cast<Slot*>(header + 1);
+}
+
+inline long futex(std::atomic<uint32_t>* word, int op, uint32_t value, const timespec* timeout) {
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), op, value, timeout, nullptr, 0);
+}
+
+class Reader final {
+public:
+    enum class Status {
+        Ok,       // result copied out
+        Empty,    // nothing new yet
+        Overrun,  // fell behind; skipped to the oldest result in the ring
+    };
+
+    Reader() = default;
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    ~Reader() noexcept { close(); }
+
+    // attach to a ring created by the producer. reading starts at the next
+    // result published.
+    bool open(const char* name) {
+        close();
+
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) < 0 || info.st_size < static_cast<off_t>(sizeof(Header))) {
+            ::close(fd);
+            return false;
+        }
+
+        // read-write, so wait() can register as a waiter.
+        auto* memory = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED)
+            return false;
+
+        m_header = static_cast<Header*>(memory);
+        m_size = info.st_size;
+
+        if (m_header->magic != kMagic || m_header->version != kVersion || m_header->slot_size != sizeof(Slot) ||
+            mapping_size(m_header->capacity) > m_size) {
+            close();
+            return false;
+        }
+
+        m_cursor = m_header->published.load(std::memory_order_acquire);
+        return true;
+    }
+
+    void close() {
+        if (m_header != nullptr)
+            munmap(m_header, m_size);
+        m_header = nullptr;
+        m_size = 0;
+    }
+
+    // copy the next result into out.
+    Status poll(Result& out) {
+        auto* ring = slots(m_header);
+        uint64_t capacity = m_header->capacity;
+
+        while (true) {
+            auto published = m_header->published.load(std::memory_order_acquire);
+            if (m_cursor >= published)
+                return Status::Empty;
+
+            if (published - m_cursor > capacity) {
+                m_dropped += published - capacity - m_cursor;
+                m_cursor = published - capacity;
+                return Status::Overrun;
+            }
+
+            auto& slot = ring[m_cursor % capacity];
+            auto expected = 2 * m_cursor + 2;
+
+            // the producer lapped us on this slot, or is rewriting it
+            if (slot.sequence.load(std::memory_order_acquire) != expected) {
+                m_dropped += 1;
+                m_cursor += 1;
+                return Status::Overrun;
+            }
+
+            std::memcpy(&out, &slot.result, sizeof(Result));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            // overwritten while copying; published tells by how much
+            if (slot.sequence.load(std::memory_order_relaxed) != expected)
+                continue;
+
+            m_cursor += 1;
+            return Status::Ok;
+        }
+    }
+
+    // block until a result newer than the last one read is published.
+    // false on timeout.
+    bool wait(int timeout_ms) {
+        auto seen = m_header->futex.load(std::memory_order_acquire);
+        if (m_header->published.load(std::memory_order_acquire) > m_cursor)
+            return true;
+
+        timespec timeout{ timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+
+        // a result published after seen was read changes the futex word,
+        // so the wait returns at once instead of missing the wake-up.
+        m_header->waiters.fetch_add(1, std::memory_order_acq_rel);
+        futex(&m_header->futex, FUTEX_WAIT, seen, &timeout);
+        m_header->waiters.fetch_sub(1, std::memory_order_acq_rel);
+
+        return m_header->published.load(std::memory_order_acquire) > m_cursor;
+    }
+
+    // results skipped because this reader fell behind.
+    uint64_t dropped() const { return m_dropped; }
+
+private:
+    Header* m_header = nullptr;
+    size_t m_size = 0;
+    uint64_t m_cursor = 0;
+    uint64_t m_dropped = 0;
+};
+
+} // namespace result_ring
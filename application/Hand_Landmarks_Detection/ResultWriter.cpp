@@ -0,0 +1,296 @@
+#include "ResultWriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// O_DIRECT writes must be aligned to the logical block size in address,
+// offset and length; a page covers every common device.
+constexpr size_t kDirectAlignment = 4096;
+
+static int64_t to_ns(FrameStamp::clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static std::string rotated_path(const std::string& path, int index) {
+    if (index == 0)
+        return path;
+
+    auto dot = path.rfind('.');
+    auto slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + "." + std::to_string(index);
+
+    return path.substr(0, dot) + "." + std::to_string(index) + path.substr(dot);
+}
+
+// static
+ResultFormat ResultWriter::format_of(const std::string& path) {
+    auto bin = std::string(".bin");
+    if (path.size() >= bin.size() && path.compare(path.size() - bin.size(), bin.size(), bin) == 0)
+        return ResultFormat::Binary;
+    return ResultFormat::Jsonl;
+}
+
+int ResultWriter::open() {
+    close();
+
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, kDirectAlignment, kResultLogBuffer) != 0) {
+        std::cerr << "error: failed to allocate result log buffer.\n";
+        return 1;
+    }
+    m_buffer.reset(static_cast<char*>(buffer));
+    m_used = 0;
+
+    m_queue.assign(kResultLogCapacity, ResultRecord{});
+    m_head = 0;
+    m_tail = 0;
+    m_dropped = 0;
+    m_index = 0;
+
+    if (open_file())
+        return 1;
+
+    m_run = true;
+    m_thread = std::thread(&ResultWriter::do_write, this);
+    return 0;
+}
+
+void ResultWriter::close() {
+    if (!m_thread.joinable() && m_fd < 0)
+        return;
+
+    m_run = false;
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    // a failed write has closed the file already
+    if (m_fd >= 0 && flush(true) == 0)
+        close_file();
+
+    if (m_dropped > 0)
+        std::cerr << "warning: " << m_dropped << " results not written to " << m_path << ".\n";
+}
+
+bool ResultWriter::append(const ResultStamp& stamp, bool detected, const std::vector<cv::Rect>& boxes,
+                          const InferEngine& engine) {
+    auto head = m_head.load(std::memory_order_relaxed);
+    while (head - m_tail.load(std::memory_order_acquire) >= m_queue.size()) {
+        if (!m_options.block || !m_run) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    auto& record = m_queue[head % m_queue.size()];
+    const auto& stages = engine.last_stages();
+
+    record.frame = stamp.frame.sequence;
+    record.captured_ns = to_ns(stamp.frame.captured);
+    record.preprocessed_ns = to_ns(stamp.preprocessed);
+    record.inferred_ns = to_ns(stamp.inferred);
+    record.detector_ms = stages.detector;
+    record.detector_post_ms = stages.detector_post;
+    record.landmark_ms = stages.landmark;
+    record.landmark_post_ms = stages.landmark_post;
+    record.score = engine.last_score();
+    record.detected = detected;
+
+    record.box_count = std::min<uint32_t>(boxes.size(), std::size(record.boxes));
+    for (uint32_t i = 0; i < record.box_count; ++i) {
+        record.boxes[i][0] = boxes[i].x;
+        record.boxes[i][1] = boxes[i].y;
+        record.boxes[i][2] = boxes[i].width;
+        record.boxes[i][3] = boxes[i].height;
+    }
+
+    // zeroed when not detected, so binary files never carry stale values
+    const auto& landmarks = engine.precise_landmarks();
+    auto count = detected ? std::min<size_t>(landmarks.size(), std::size(record.landmarks)) : 0;
+    for (size_t i = 0; i < std::size(record.landmarks); ++i) {
+        record.landmarks[i][0] = (i < count) ? landmarks[i].x : 0.0f;
+        record.landmarks[i][1] = (i < count) ? landmarks[i].y : 0.0f;
+    }
+
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+void ResultWriter::do_write() {
+    // polled instead of signalled, so append() never touches a lock.
+    // at camera rate a period holds a handful of results.
+    char line[4096];
+    auto last_flush = std::chrono::steady_clock::now();
+
+    while (true) {
+        bool run = m_run;
+
+        auto head = m_head.load(std::memory_order_acquire);
+        for (auto tail = m_tail.load(std::memory_order_relaxed); tail != head; ++tail) {
+            const auto& record = m_queue[tail % m_queue.size()];
+
+            if (m_options.format == ResultFormat::Binary)
+                append_bytes(reinterpret_cast<const char*>(&record), sizeof(record));
+            else
+                append_bytes(line, format_json(record, line, sizeof(line)));
+
+            m_tail.store(tail + 1, std::memory_order_release);
+        }
+
+        if (!run)
+            break;
+
+        // bound what a crash loses without giving up large writes
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_flush >= std::chrono::milliseconds(kResultLogFlushMS)) {
+            flush(false);
+            last_flush = now;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(kResultLogPollMS));
+    }
+}
+
+int ResultWriter::open_file() {
+    auto path = rotated_path(m_path, m_index);
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    if (m_options.direct)
+        flags |= O_DIRECT;
+
+    m_fd = ::open(path.c_str(), flags, 0644);
+    if (m_fd < 0 && m_options.direct && errno == EINVAL) {
+        // e.g. tmpfs
+        std::cerr << "warning: " << path << " does not support O_DIRECT, writing buffered.\n";
+        m_options.direct = false;
+        m_fd = ::open(path.c_str(), flags & ~O_DIRECT, 0644);
+    }
+
+    if (m_fd < 0) {
+        std::cerr << "error: failed to open " << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    // reserved without growing the file, so it stays readable while written
+    if (m_options.preallocate && m_options.rotate_bytes > 0)
+        fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, m_options.rotate_bytes);
+
+    m_file_bytes = 0;
+
+    if (m_options.format == ResultFormat::Binary) {
+        ResultFileHeader header;
+        header.record_size = sizeof(ResultRecord);
+        return append_bytes(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    return 0;
+}
+
+void ResultWriter::close_file() {
+    // unused preallocation past the end is given back
+    if (m_options.preallocate && m_options.rotate_bytes > 0)
+        ftruncate(m_fd, m_file_bytes);
+
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+int ResultWriter::append_bytes(const char* data, size_t size) {
+    if (m_fd < 0)
+        return 1;
+
+    // rotate on a record boundary, never leaving a file empty
+    auto file_size = m_file_bytes + m_used;
+    if (m_options.rotate_bytes > 0 && file_size > sizeof(ResultFileHeader) &&
+        file_size + size > m_options.rotate_bytes) {
+        if (flush(true))
+            return 1;
+        close_file();
+
+        m_index += 1;
+        if (open_file())
+            return 1;
+    }
+
+    if (m_used + size > kResultLogBuffer && flush(false))
+        return 1;
+
+    // records are far smaller than the buffer, so one always fits now
+    std::memcpy(m_buffer.get() + m_used, data, size);
+    m_used += size;
+    return 0;
+}
+
+// write out the buffer. O_DIRECT writes whole blocks only and keeps the
+// rest buffered, unless all is set.
+int ResultWriter::flush(bool all) {
+    auto size = m_used;
+    if (m_options.direct && !all)
+        size -= size % kDirectAlignment;
+
+    if (size > 0 && m_options.direct && size % kDirectAlignment != 0) {
+        // the unaligned tail at the end of a file
+        fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        auto n = ::write(m_fd, m_buffer.get() + written, size - written);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            std::cerr << "error: failed to write " << rotated_path(m_path, m_index) << ": " << strerror(errno) << "\n";
+            ::close(m_fd);
+            m_fd = -1;
+            return 1;
+        }
+        written += n;
+    }
+
+    m_file_bytes += size;
+    m_used -= size;
+    if (m_used > 0)
+        std::memmove(m_buffer.get(), m_buffer.get() + size, m_used);
+
+    return 0;
+}
+
+size_t ResultWriter::format_json(const ResultRecord& record, char* out, size_t size) const {
+    size_t used = 0;
+    auto print = [&](const char* format, auto... args) {
+        if (used < size)
+            used += std::min<size_t>(snprintf(out + used, size - used, format, args...), size - used - 1);
+    };
+
+    print("{\"frame\":%lld,\"captured_ns\":%lld,\"preprocessed_ns\":%lld,\"inferred_ns\":%lld,",
+          static_cast<long long>(record.frame), static_cast<long long>(record.captured_ns),
+          static_cast<long long>(record.preprocessed_ns), static_cast<long long>(record.inferred_ns));
+    print("\"stages_ms\":{\"detector\":%.3f,\"detector_post\":%.3f,\"landmark\":%.3f,\"landmark_post\":%.3f},",
+          record.detector_ms, record.detector_post_ms, record.landmark_ms, record.landmark_post_ms);
+    print("\"detected\":%s,\"score\":%.4f,\"boxes\":[", record.detected ? "true" : "false", record.score);
+
+    for (uint32_t i = 0; i < record.box_count; ++i) {
+        print("%s[%d,%d,%d,%d]", (i > 0) ? "," : "", record.boxes[i][0], record.boxes[i][1], record.boxes[i][2],
+              record.boxes[i][3]);
+    }
+
+    print("],\"landmarks\":[");
+    if (record.detected) {
+        for (size_t i = 0; i < std::size(record.landmarks); ++i)
+            print("%s[%.2f,%.2f]", (i > 0) ? "," : "", record.landmarks[i][0], record.landmarks[i][1]);
+    }
+    print("]}\n");
+
+    return used;
+}
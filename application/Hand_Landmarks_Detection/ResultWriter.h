@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Defs.h"
+#include "FrameStamp.h"
+#include "InferEngine.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams every result to a file for offline analysis.
+//
+// append() only copies the result into a preallocated queue; formatting
+// and file i/o happen on the writer's own thread in large blocks, so the
+// inference thread never waits on the disk. Results are dropped, not
+// waited for, if the disk falls that far behind.
+//
+// Binary files start with a ResultFileHeader followed by fixed-size
+// ResultRecords in native byte order. JSONL files hold one object per
+// result with the same fields.
+
+enum class ResultFormat {
+    Jsonl,
+    Binary,
+};
+
+struct ResultFileHeader {
+    uint32_t magic = kResultLogMagic;
+    uint32_t version = 1;
+    uint32_t record_size;
+    uint32_t reserved = 0;
+};
+
+struct ResultRecord {
+    int64_t frame;             // capture sequence, -1 if unstamped
+    int64_t captured_ns;       // steady_clock
+    int64_t preprocessed_ns;
+    int64_t inferred_ns;
+    float detector_ms;         // stages of the inference, see StageTimes
+    float detector_post_ms;
+    float landmark_ms;
+    float landmark_post_ms;
+    float score;               // palm confidence, or hand presence on tracked frames
+    uint32_t detected;         // landmarks are valid
+    uint32_t box_count;
+    int32_t boxes[4][4];       // x, y, width, height in frame pixels
+    float landmarks[21][2];    // x, y in frame pixels
+};
+
+struct ResultWriterOptions {
+    ResultFormat format = ResultFormat::Jsonl;
+    uint64_t rotate_bytes = kResultLogRotateBytes;  // start a new file past this size, 0 never
+    bool direct = false;       // O_DIRECT, bypassing the page cache
+    bool preallocate = true;   // reserve each file's rotation size up front
+    bool block = false;        // wait for room instead of dropping, for offline runs
+};
+
+class ResultWriter final {
+public:
+    // later files of a rotation get .1, .2, ... inserted before the
+    // extension of path.
+    explicit ResultWriter(std::string path, const ResultWriterOptions& options = {})
+        : m_path(std::move(path)), m_options(options) {}
+
+    ResultWriter(const ResultWriter&) = delete;
+    ResultWriter& operator=(const ResultWriter&) = delete;
+
+    ~ResultWriter() noexcept { close(); }
+
+    // binary if path ends in .bin, jsonl otherwise.
+    static ResultFormat format_of(const std::string& path);
+
+    int open();
+
+    // writes out everything queued.
+    void close();
+
+    // single producer: only call from one thread at a time. false if the
+    // result was dropped, which only happens if options.block is unset.
+    bool append(const ResultStamp& stamp, bool detected, const std::vector<cv::Rect>& boxes, const InferEngine& engine);
+
+    uint64_t dropped() const { return m_dropped; }
+
+private:
+    std::string m_path;
+    ResultWriterOptions m_options;
+
+    // single producer, single consumer
+    std::vector<ResultRecord> m_queue;
+    std::atomic<uint64_t> m_head = 0;  // next record to append
+    std::atomic<uint64_t> m_tail = 0;  // next record to write
+    std::atomic<uint64_t> m_dropped = 0;
+
+    std::thread m_thread;
+    std::atomic<bool> m_run = false;
+
+    // writer thread only
+    int m_fd = -1;
+    int m_index = 0;                  // of the file in the rotation
+    uint64_t m_file_bytes = 0;        // written to the current file
+    std::unique_ptr<char, void (*)(void*)> m_buffer{nullptr, free};
+    size_t m_used = 0;
+
+    void do_write();
+
+    int open_file();
+    void close_file();
+    int append_bytes(const char* data, size_t size);
+    int flush(bool all);
+    size_t format_json(const ResultRecord& record, char* out, size_t size) const;
+};
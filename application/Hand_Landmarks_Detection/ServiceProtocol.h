@@ -0,0 +1,191 @@
+#pragma once
+
+// Wire format of rpi-daemon, and a client for it.
+//
+// Header only; clients need this file and ResultRing.h, nothing else:
+//
+//   service::Client client;
+//   client.connect(service::kDefaultSocket);
+//
+//   // frames live in a memfd shared once with the daemon, sealed so it
+//   // cannot shrink under the daemon's mapping. unsealed or plain files
+//   // are refused.
+//   int fd = memfd_create("frames", MFD_ALLOW_SEALING);
+//   ftruncate(fd, size);
+//   fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK);
+//   client.attach(0, fd, size);
+//
+//   service::FrameMessage frame;
+//   frame.buffer = 0;
+//   frame.id = 1;
+//   frame.width = 640; frame.height = 480; frame.stride = 640 * 3;
+//   client.submit(frame);
+//
+//   service::ResultMessage result;
+//   client.receive(result, 100);
+//
+// Messages go over a SOCK_SEQPACKET Unix socket, one struct per message.
+// Pixels never go through the socket: the daemon maps attached buffers and
+// reads frames from them in place. Every submitted frame gets exactly one
+// result message, possibly out of order with other clients' but in order
+// for one client. A frame replaced by a newer one of the same client
+// before it was picked up is answered with Status::Replaced, so the buffer
+// it was in may be reused once any result for it has arrived.
+
+#include "ResultRing.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace service {
+
+constexpr uint32_t kVersion = 1;
+constexpr auto kDefaultSocket = "/tmp/rpi-daemon.sock";
+
+enum class MessageType : uint32_t {
+    Attach = 1,  // share a buffer; its fd is passed with SCM_RIGHTS
+    Detach = 2,
+    Frame = 3,
+    Result = 4,
+};
+
+enum class PixelFormat : uint32_t {
+    BGR24 = 1,
+};
+
+enum class Status : uint32_t {
+    Inferred = 0,
+    Replaced = 1,    // a newer frame of this client arrived first
+    Expired = 2,     // waited in the queue past the daemon's deadline
+    BadRequest = 3,  // unknown buffer, out of bounds or unsupported format
+    Busy = 4,        // too many clients; the connection is closed after this
+};
+
+struct MessageHeader {
+    MessageType type;
+    uint32_t version = kVersion;
+};
+
+struct AttachMessage {
+    MessageHeader header{ MessageType::Attach };
+    uint32_t buffer = 0;  // client chosen id
+    uint64_t size = 0;    // bytes to map
+};
+
+struct DetachMessage {
+    MessageHeader header{ MessageType::Detach };
+    uint32_t buffer = 0;
+};
+
+// only 640x480 BGR frames are accepted, as from the camera.
+struct FrameMessage {
+    MessageHeader header{ MessageType::Frame };
+    uint32_t buffer = 0;
+    uint64_t id = 0;          // echoed in the result
+    uint64_t offset = 0;      // of the first row in the buffer
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t stride = 0;       // bytes per row
+    PixelFormat format = PixelFormat::BGR24;
+    int64_t captured_ns = 0;  // steady_clock, 0 for when it is received
+};
+
+struct ResultMessage {
+    MessageHeader header{ MessageType::Result };
+    Status status = Status::Inferred;
+    uint64_t id = 0;
+    result_ring::Result result{};  // frame is the daemon's sequence
+};
+
+class Client final {
+public:
+    Client() = default;
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    ~Client() noexcept { close(); }
+
+    bool connect(const char* path) {
+        close();
+
+        m_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (m_fd < 0)
+            return false;
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+        if (::connect(m_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void close() {
+        if (m_fd >= 0)
+            ::close(m_fd);
+        m_fd = -1;
+    }
+
+    // for callers multiplexing several descriptors.
+    int fd() const { return m_fd; }
+
+    // share size bytes of fd as buffer. only memfds sealed with
+    // F_SEAL_SHRINK are accepted; the daemon ignores other descriptors.
+    // fd may be closed by the caller afterwards.
+    bool attach(uint32_t buffer, int fd, uint64_t size) {
+        AttachMessage message;
+        message.buffer = buffer;
+        message.size = size;
+
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        iovec data{ &message, sizeof(message) };
+
+        msghdr header{};
+        header.msg_iov = &data;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        auto* cmsg = CMSG_FIRSTHDR(&header);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+        return sendmsg(m_fd, &header, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(message));
+    }
+
+    bool detach(uint32_t buffer) {
+        DetachMessage message;
+        message.buffer = buffer;
+        return send(m_fd, &message, sizeof(message), MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(message));
+    }
+
+    bool submit(const FrameMessage& frame) {
+        return send(m_fd, &frame, sizeof(frame), MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(frame));
+    }
+
+    // wait up to timeout_ms for the next result. false on timeout or if
+    // the daemon went away.
+    bool receive(ResultMessage& out, int timeout_ms) {
+        pollfd events{ m_fd, POLLIN, 0 };
+        if (poll(&events, 1, timeout_ms) <= 0)
+            return false;
+
+        return recv(m_fd, &out, sizeof(out), 0) == static_cast<ssize_t>(sizeof(out)) && out.header.type == MessageType::Result;
+    }
+
+private:
+    int m_fd = -1;
+};
+
+} // namespace service
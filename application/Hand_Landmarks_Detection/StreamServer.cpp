@@ -0,0 +1,226 @@
+#include "StreamServer.h"
+#include "Preprocess.h"
+
+#include <iostream>
+
+StreamServer::StreamServer(std::vector<InferEngine*> engines, int streams, std::chrono::milliseconds deadline)
+    : m_deadline(deadline) {
+    for (auto i = 0; i < streams; ++i)
+        m_streams.push_back(std::make_unique<Stream>());
+
+    for (auto* engine : engines) {
+        auto worker = std::make_unique<Worker>();
+        worker->engine = engine;
+        m_workers.push_back(std::move(worker));
+    }
+}
+
+int StreamServer::start() {
+    if (m_workers.empty()) {
+        std::cerr << "error: no engine in pool.\n";
+        return 1;
+    }
+
+    m_run = true;
+    for (size_t i = 0; i < m_workers.size(); ++i)
+        m_workers[i]->thread = std::thread(&StreamServer::do_work, this, i);
+
+    return 0;
+}
+
+void StreamServer::stop() {
+    {
+        std::unique_lock lock(m_lock);
+        m_run = false;
+    }
+    m_cv.notify_all();
+
+    for (auto& worker : m_workers) {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+}
+
+void StreamServer::submit(int stream, const cv::Mat& frame, clock::time_point captured, int64_t tag) {
+    auto& s = *m_streams[stream];
+    bool wake = false;
+    Result replaced;
+
+    {
+        std::unique_lock lock(s.lock);
+        if (s.has_pending) {
+            s.stats.replaced += 1;
+            replaced.sequence = s.sequence;
+            replaced.tag = s.tag;
+        }
+
+        frame.copyTo(s.pending);
+        s.captured = captured;
+        s.sequence += 1;
+        s.tag = tag;
+        s.stats.submitted += 1;
+        s.has_pending = true;
+
+        if (!s.queued && !s.busy) {
+            s.queued = true;
+            wake = true;
+        }
+    }
+
+    if (replaced.sequence >= 0 && m_completion)
+        m_completion(stream, Outcome::Replaced, replaced);
+
+    if (wake)
+        enqueue(stream);
+}
+
+bool StreamServer::result(int stream, Result& out) const {
+    auto& s = *m_streams[stream];
+
+    std::unique_lock lock(s.lock);
+    if (s.result.sequence < 0)
+        return false;
+
+    out = s.result;
+    return true;
+}
+
+StreamServer::Stats StreamServer::stats(int stream) const {
+    auto& s = *m_streams[stream];
+
+    std::unique_lock lock(s.lock);
+    return s.stats;
+}
+
+void StreamServer::enqueue(int stream) {
+    auto& owner = *m_workers[stream % m_workers.size()];
+
+    {
+        std::unique_lock lock(owner.lock);
+        owner.queue.push_back(stream);
+    }
+
+    {
+        std::unique_lock lock(m_lock);
+        m_ready += 1;
+    }
+    m_cv.notify_one();
+}
+
+bool StreamServer::take(size_t worker, int& stream) {
+    // own queue first, oldest entry
+    {
+        auto& self = *m_workers[worker];
+        std::unique_lock lock(self.lock);
+        if (!self.queue.empty()) {
+            stream = self.queue.front();
+            self.queue.pop_front();
+            m_ready -= 1;
+            return true;
+        }
+    }
+
+    // steal newest entry from others
+    for (size_t i = 1; i < m_workers.size(); ++i) {
+        auto& victim = *m_workers[(worker + i) % m_workers.size()];
+        std::unique_lock lock(victim.lock);
+        if (!victim.queue.empty()) {
+            stream = victim.queue.back();
+            victim.queue.pop_back();
+            m_ready -= 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void StreamServer::process(Worker& worker, int stream) {
+    auto& s = *m_streams[stream];
+    clock::time_point captured;
+    int64_t sequence;
+    int64_t tag;
+
+    {
+        std::unique_lock lock(s.lock);
+        s.queued = false;
+        if (!s.has_pending)
+            return;
+
+        cv::swap(s.pending, worker.frame);
+        s.has_pending = false;
+        s.busy = true;
+        captured = s.captured;
+        sequence = s.sequence;
+        tag = s.tag;
+    }
+
+    bool expired = clock::now() - captured > m_deadline;
+    bool detected = false;
+    float latency = 0.0f;
+
+    if (!expired) {
+        auto begin = clock::now();
+
+        preprocessFrame(worker.frame, worker.rgb, worker.resized, worker.padded, worker.engine->det_input());
+
+        worker.landmarks.clear();
+        worker.faces.clear();
+        detected = worker.engine->do_infer(worker.padded, worker.landmarks, worker.faces);
+
+        latency = std::chrono::duration<float, std::milli>(clock::now() - begin).count();
+    }
+
+    bool requeue = false;
+    Result completed;
+    {
+        std::unique_lock lock(s.lock);
+        s.busy = false;
+
+        if (expired) {
+            s.stats.expired += 1;
+            completed.sequence = sequence;
+            completed.tag = tag;
+        } else {
+            s.stats.inferred += 1;
+            s.result.sequence = sequence;
+            s.result.tag = tag;
+            s.result.detected = detected;
+            s.result.latency = latency;
+            if (detected) {
+                std::swap(s.result.landmarks, worker.landmarks);
+                s.result.precise_landmarks = worker.engine->precise_landmarks();
+            }
+            std::swap(s.result.boxes, worker.faces);
+
+            if (m_completion)
+                completed = s.result;
+        }
+
+        if (s.has_pending && !s.queued) {
+            s.queued = true;
+            requeue = true;
+        }
+    }
+
+    if (m_completion)
+        m_completion(stream, expired ? Outcome::Expired : Outcome::Inferred, completed);
+
+    if (requeue)
+        enqueue(stream);
+}
+
+void StreamServer::do_work(size_t worker) {
+    auto& self = *m_workers[worker];
+
+    while (m_run) {
+        int stream;
+        if (!take(worker, stream)) {
+            std::unique_lock lock(m_lock);
+            m_cv.wait(lock, [this] { return !m_run || m_ready > 0; });
+            continue;
+        }
+
+        process(self, stream);
+    }
+}
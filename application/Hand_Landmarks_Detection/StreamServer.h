@@ -0,0 +1,121 @@
+#pragma once
+
+#include "InferEngine.h"
+#include "Defs.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Serves several capture streams from a fixed pool of engines.
+//
+// Each stream keeps only its latest frame and has at most one frame in
+// flight, so a fast camera cannot starve a slow one. Every worker owns one
+// engine and a queue of ready streams; idle workers steal from the back of
+// other workers' queues. Frames that waited longer than the deadline are
+// dropped instead of inferred.
+class StreamServer final {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Result {
+        int64_t sequence = -1;
+        int64_t tag = -1;     // as given to submit()
+        bool detected = false;
+        std::vector<cv::Point> landmarks;
+        std::vector<cv::Point2f> precise_landmarks;
+        std::vector<cv::Rect> boxes;
+        float latency = 0.0f; // ms
+    };
+
+    enum class Outcome {
+        Inferred,
+        Replaced, // a newer frame of the stream arrived before pickup
+        Expired,  // waited longer than the deadline
+    };
+
+    // called once for every submitted frame, from a worker or from
+    // submit(). only sequence and tag are set unless inferred.
+    using Completion = std::function<void(int stream, Outcome outcome, const Result& result)>;
+
+    struct Stats {
+        int64_t submitted = 0;
+        int64_t inferred = 0;
+        int64_t replaced = 0; // overwritten by a newer frame before pickup
+        int64_t expired = 0;  // dropped after missing the deadline
+    };
+
+    StreamServer(std::vector<InferEngine*> engines, int streams,
+                 std::chrono::milliseconds deadline = std::chrono::milliseconds(kStreamDeadlineMS));
+
+    ~StreamServer() noexcept { stop(); }
+
+    int start();
+
+    void stop();
+
+    // must be called before start().
+    void set_completion(Completion completion) { m_completion = std::move(completion); }
+
+    // hand over a frame of stream. the frame is copied. tag is passed
+    // through to the result.
+    void submit(int stream, const cv::Mat& frame, clock::time_point captured, int64_t tag = -1);
+
+    // copy the latest result of stream. false if nothing is inferred yet.
+    bool result(int stream, Result& out) const;
+
+    Stats stats(int stream) const;
+
+    size_t workers() const { return m_workers.size(); }
+
+private:
+    struct Stream {
+        mutable std::mutex lock;
+        cv::Mat pending;
+        clock::time_point captured;
+        int64_t sequence = 0;
+        int64_t tag = -1;
+        bool has_pending = false;
+        bool queued = false;
+        bool busy = false;
+        Result result;
+        Stats stats;
+    };
+
+    struct Worker {
+        InferEngine* engine = nullptr;
+        std::mutex lock;
+        std::deque<int> queue;
+        std::thread thread;
+
+        cv::Mat frame;
+        cv::Mat rgb;
+        cv::Mat resized;
+        cv::Mat padded;
+        std::vector<cv::Point> landmarks;
+        std::vector<cv::Rect> faces;
+    };
+
+    std::vector<std::unique_ptr<Stream>> m_streams;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::chrono::milliseconds m_deadline;
+    Completion m_completion;
+
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::atomic<int> m_ready = 0;
+    std::atomic<bool> m_run = false;
+
+    void enqueue(int stream);
+    bool take(size_t worker, int& stream);
+    void process(Worker& worker, int stream);
+    void do_work(size_t worker);
+};
@@ -1,7 +1,10 @@
 #include "InferEngine.h"
+#include "TFLite.h"
 #include "Defs.h"
 #include "Postprocess.h"
 #include "nms.h"
+#include "Affinity.h"
+#include "BatchDetector.h"
 
 #include <tensorflow/lite/interpreter.h>
 #include <tensorflow/lite/kernels/register.h>
@@ -13,200 +16,208 @@
 #include <opencv2/core/core.hpp>
 
 #include <cmath>
+#include <cstring>
 #include <numeric>
 #include <iterator>
 #include <iostream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <unistd.h>
 
 constexpr auto TFLiteDetModelPath = "palm_detection_lite.tflite";
 constexpr auto TFLiteLandmarkModelPath = "hand_landmark_lite.tflite";
-constexpr auto AnchorsPath = "anchors.csv";
+constexpr auto TFLiteDetWeightCacheName = "palm_detection_lite";
+constexpr auto TFLiteLandmarkWeightCacheName = "hand_landmark_lite";
+
+constexpr auto TFLiteFullDetModelPath = "palm_detection_full.tflite";
+constexpr auto TFLiteFullLandmarkModelPath = "hand_landmark_full.tflite";
+constexpr auto TFLiteFullDetWeightCacheName = "palm_detection_full";
+constexpr auto TFLiteFullLandmarkWeightCacheName = "hand_landmark_full";
 
 using timer = std::chrono::high_resolution_clock;
 
 class TFLiteInferEngine final : public InferEngine {
 public:
-    TFLiteInferEngine(std::unique_ptr<tflite::Interpreter> interpreter, std::unique_ptr<tflite::Interpreter> detinterpreter)
-        : m_interpreter(std::move(interpreter)), det_interpreter(std::move(detinterpreter)) {
+    TFLiteInferEngine(std::unique_ptr<tflite::FlatBufferModel> model, std::unique_ptr<tflite::FlatBufferModel> detmodel,
+                      TfLiteDelegatePtr delegate, TfLiteDelegatePtr detdelegate,
+                      std::unique_ptr<tflite::Interpreter> interpreter, std::unique_ptr<tflite::Interpreter> detinterpreter)
+        : m_model(std::move(model)), det_model(std::move(detmodel)),
+          m_delegate(std::move(delegate)), det_delegate(std::move(detdelegate)),
+          m_interpreter(std::move(interpreter)), det_interpreter(std::move(detinterpreter)) {
         m_output_size = m_interpreter->output_tensor(0)->bytes / sizeof(float);
         det_output_size = det_interpreter->output_tensor(0)->bytes / sizeof(float); 
-        anchors = loadAnchors(AnchorsPath);
+
+        // tensor buffers do not move after AllocateTensors()
+        m_det_input = cv::Mat(detInputSize, detInputSize, CV_32FC3, det_interpreter->typed_input_tensor<float>(0));
+        m_det_boxes = det_interpreter->typed_output_tensor<float>(0);
+        m_det_scores = det_interpreter->typed_output_tensor<float>(1);
+        m_land_input = cv::Mat(kInputSize, kInputSize, CV_32FC3, m_interpreter->typed_input_tensor<float>(0));
+        m_land_output = m_interpreter->typed_output_tensor<float>(0);
+
+        for (size_t i = 0; i < m_interpreter->outputs().size(); ++i) {
+            if (std::strcmp(m_interpreter->GetOutputName(i), "Identity_1") == 0)
+                m_land_presence = m_interpreter->typed_output_tensor<float>(i);
+        }
     }
 
-    bool do_infer(const cv::Mat& data, cv::Mat& land_data, std::vector<cv::Point>& landmarks, std::vector<cv::Rect>& faces) override {
-        handDetected = false;
-        auto* raw_input = det_interpreter->typed_input_tensor<float>(0);
-        
-        cv::Mat det_input(detInputSize, detInputSize, CV_32FC3, raw_input);
-        data.copyTo(det_input);
-	
-        auto begin = timer::now();
+    bool invoke_detector() override {
         if (det_interpreter->Invoke() != kTfLiteOk) {
             std::cerr << "error: failed to invoke interpreter.\n";
             return false;
         }
-        auto palm_end = timer::now();
-        auto palm_time = (palm_end - begin).count();
-        
-        auto* rawBoxes = det_interpreter->typed_output_tensor<float>(0);
-        auto* rawScores = det_interpreter->typed_output_tensor<float>(1);
-
-        // Apply sigmoid to confidence scores
-        sigmoid_score(rawScores);
-
-        // Decode boxes with pre-defined anchors
-        auto *decodedBoxes = rawBoxes;
-        for (auto i = 0; i < detclnum; ++i) {
-            const float* anchor = &anchors[i * 4];      // Each anchor has 4 values
-            float* decodedBox = &decodedBoxes[i * 18];  // Each decoded box also has 18 values
-
-            decodedBox[0] += anchor[0] * 192;           // dx + anchor_x * input size
-            decodedBox[1] += anchor[1] * 192;           // dy + anchor_y * input size
-        }
-
-        // Filter out boxes with confidence threshold
-        candidateDetect.clear();
-        filteredProbabilities.clear();
-        indices.clear();
-        for (auto i = 0; i < detclnum; ++i) {
-            if (rawScores[i] <= confidenceThreshold)
-                continue;
-            candidateDetect.emplace_back(decodedBoxes + i * 18);
-            filteredProbabilities.push_back(rawScores[i]);
-            indices.push_back(i);
-        }
+        return true;
+    }
 
-        // If at least one box is detected, proceed palm(hand) detection
-        boxIds.clear();
-        boxIds = nonMaximumSuppression(candidateDetect, filteredProbabilities);
-
-        // If at least single box is detected, rpoceed landmark detection
-        if (!boxIds.empty()){
-            int boxId = boxIds[0];
-            BoundBox detect = candidateDetect[boxId];
-            auto *ptr = anchors + 4 * indices[boxId];
-            cv::Point2f center_wo_offset(*ptr * 192, *(ptr + 1) * 192);
-
-            // Extract details for the first detected hand
-            auto [sourceTriangle, keypoints] = extractHandDetails(
-                detect, center_wo_offset
-            );
-
-            cv::Size originalSize(kHeight, kWidth);
-            cv::Size padding(detPadHeight, detPadWidth);
-
-            // If at least one hand is detected, proceed landmark detection
-            if (!sourceTriangle.empty()){
-                // Compute scale and affine transformation matrix
-                float scale = static_cast<float>(std::max(originalSize.width, originalSize.height)) / detInputSize;
-                cv::Mat affineMatrix = computeAffineMatrix(sourceTriangle, scale);
-
-                // Warp the hand region
-                // cv::Mat warpedImage = warpHandRegion(land_data, affineMatrix);
-
-                // Hand landmark model inference
-                auto* landmark_raw_input = m_interpreter->typed_input_tensor<float>(0);
-                cv::Mat landmark_input(kInputSize, kInputSize, CV_32FC3, landmark_raw_input);
-                warpHandRegion(land_data, affineMatrix, landmark_input);
-
-                auto palm_post_end = timer::now();
-                auto palm_post_time = (palm_post_end - palm_end).count();
-                if (m_interpreter->Invoke() != kTfLiteOk) {
-                    std::cerr << "error: failed to invoke interpreter.\n";
-                    return false;
-                }
-                auto landmark_end = timer::now();
-                auto landmark_time = (landmark_end - palm_post_end).count();
-
-                auto* outraw = m_interpreter->typed_output_tensor<float>(0);
-
-                // Extract landmarks
-                std::vector<std::array<float, 3>> joints = extractLandmarks(outraw);
-                
-                // Pad affine matrix and compute inverse
-                cv::Mat paddedMatrix = cv::Mat::eye(3, 3, CV_32F);
-                affineMatrix.copyTo(paddedMatrix(cv::Rect(0, 0, 3, 2)));
-                cv::Mat inverseMatrix = paddedMatrix.inv();        
-
-                landmarks = projectLandmarksToOriginal(joints, inverseMatrix, padding);
-                handDetected = true;
-
-                auto end = timer::now();
-                auto landmark_post_time = (end - landmark_end).count();
-
-                auto total_time = palm_time + palm_post_time + landmark_time + landmark_post_time;
-
-#if 0
-                std::cout << "TFLite Total time: " << total_time / 1000.0f << "us" << std::endl;
-                std::cout << "  - Palm: " << palm_time / 1000.0f << "us (" << palm_time * 100.0f / total_time << "%)" << std::endl;
-                std::cout << "  - Palm post: " << palm_post_time / 1000.0f << "us (" << palm_post_time * 100.0f / total_time << "%)" << std::endl;
-                std::cout << "  - Landmark: " << landmark_time / 1000.0f << "us (" << landmark_time * 100.0f / total_time << "%)" << std::endl;
-                std::cout << "  - Landmark post: " << landmark_post_time / 1000.0f << "us (" << landmark_post_time * 100.0f / total_time << "%)" << std::endl;
-#endif
-                models_latencies[models_counter++ % 10] += total_time;
-                if (models_counter > 10){
-                    models_average = std::accumulate(std::begin(models_latencies), std::end(models_latencies), int64_t(0)) / (10 * 1000000.0f);
-                }
-            }
+    bool invoke_landmark() override {
+        if (m_interpreter->Invoke() != kTfLiteOk) {
+            std::cerr << "error: failed to invoke interpreter.\n";
+            return false;
         }
-        return handDetected;
+        return true;
     }
 
 private:
+    // models and delegates must outlive the interpreters using them.
+    std::unique_ptr<tflite::FlatBufferModel> m_model;
+    std::unique_ptr<tflite::FlatBufferModel> det_model;
+    TfLiteDelegatePtr m_delegate;
+    TfLiteDelegatePtr det_delegate;
     std::unique_ptr<tflite::Interpreter> m_interpreter;
     std::unique_ptr<tflite::Interpreter> det_interpreter;
     size_t m_output_size;
     size_t det_output_size;
-    float* anchors;
+};
 
-    bool handDetected = false;
+// packed weights differ with the operators the delegate takes, so each
+// set of options gets its own file.
+static std::string weight_cache_path(const char* name, const XNNPackOptions& options) {
+    std::string path = name;
+    if (options.fp16)
+        path += ".fp16";
+    if (options.quantized)
+        path += ".q8";
+    return path + ".xnnpack_cache";
+}
+
+// A weight cache file shared by every engine of a model, in this process
+// and others. XNNPACK writes a missing cache while it packs, so engines
+// created at the same time would race on it, or map it half written.
+//
+// Only one engine per file builds it at a time, into a temporary file
+// that is renamed over the cache once the engine is warm. Engines
+// created meanwhile wait, then map the finished file.
+class WeightCacheFile final {
+public:
+    explicit WeightCacheFile(std::string path) : m_path(std::move(path)), m_lock(mutex_of(m_path)) {
+        if (access(m_path.c_str(), F_OK) == 0) {
+            m_lock.unlock();
+            return;
+        }
 
-    std::vector<BoundBox> candidateDetect;
-    std::vector<float> filteredProbabilities;
-    std::vector<int> indices;
-    std::vector<int> boxIds;
-};
+        // the lock keeps other threads out, the pid other processes
+        m_building = m_path + ".tmp" + std::to_string(getpid());
+        ::unlink(m_building.c_str());
+    }
 
-// static
-std::unique_ptr<InferEngine> InferEngine::create_tflite_engine() {
-    auto detmodel = tflite::FlatBufferModel::BuildFromFile(TFLiteDetModelPath);
-    auto model = tflite::FlatBufferModel::BuildFromFile(TFLiteLandmarkModelPath);
+    WeightCacheFile(const WeightCacheFile&) = delete;
+    WeightCacheFile& operator=(const WeightCacheFile&) = delete;
 
-    if (!detmodel) {
-        std::cerr << "error: failed to tflite detection model\n";
-        return nullptr;
+    // an uncommitted cache may be incomplete.
+    ~WeightCacheFile() noexcept {
+        if (!m_building.empty())
+            ::unlink(m_building.c_str());
     }
 
-    if (!model) {
-        std::cerr << "error: failed to tflite model\n";
-        return nullptr;
+    // where the delegate reads or writes the cache.
+    const char* path() const { return m_building.empty() ? m_path.c_str() : m_building.c_str(); }
+
+    // the engine packed into the cache and ran: publish it.
+    void commit() {
+        if (m_building.empty())
+            return;
+
+        if (std::rename(m_building.c_str(), m_path.c_str()) != 0) {
+            std::cerr << "warning: failed to save " << m_path << ": " << strerror(errno) << "\n";
+            ::unlink(m_building.c_str());
+        }
+
+        m_building.clear();
+        m_lock.unlock();
     }
 
-    tflite::ops::builtin::BuiltinOpResolver resolver;
-    std::unique_ptr<tflite::Interpreter> detinterpreter;
-    auto detbuilder = tflite::InterpreterBuilder(*detmodel, resolver);
-    std::unique_ptr<tflite::Interpreter> interpreter;
-    auto builder = tflite::InterpreterBuilder(*model, resolver);
+private:
+    std::string m_path;
+    std::unique_lock<std::mutex> m_lock;
+    std::string m_building;  // temporary file while this engine builds the cache
 
-    if (detbuilder(&detinterpreter) != TfLiteStatus::kTfLiteOk) {
-        std::cerr << "error: failed to create det interpreter.\n";
-        return nullptr;
+    static std::mutex& mutex_of(const std::string& path) {
+        static std::mutex lock;
+        static std::map<std::string, std::mutex> mutexes;
+
+        std::unique_lock guard(lock);
+        return mutexes[path];
     }
+};
+
+TfLiteDelegatePtr create_xnnpack_delegate(const XNNPackOptions& options, const char* cache_path) {
+    auto delegate_options = TfLiteXNNPackDelegateOptionsDefault();
+    delegate_options.num_threads = options.threads;
+
+    if (options.fp16)
+        delegate_options.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_FORCE_FP16;
+
+    if (options.quantized)
+        delegate_options.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_QS8 | TFLITE_XNNPACK_DELEGATE_FLAG_QU8;
+    else
+        delegate_options.flags &= ~(TFLITE_XNNPACK_DELEGATE_FLAG_QS8 | TFLITE_XNNPACK_DELEGATE_FLAG_QU8);
+
+    // packed weights are written to cache_path on first run and mapped on
+    // the next ones.
+    if (options.weight_cache)
+        delegate_options.weight_cache_file_path = cache_path;
 
+    return TfLiteDelegatePtr(TfLiteXNNPackDelegateCreate(&delegate_options), TfLiteXNNPackDelegateDelete);
+}
+
+std::unique_ptr<tflite::Interpreter> create_interpreter(const tflite::FlatBufferModel& model, TfLiteDelegate* delegate, int threads,
+                                                       int batch) {
+    // do not let the resolver apply its own default xnnpack delegate.
+    tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+    std::unique_ptr<tflite::Interpreter> interpreter;
+    auto builder = tflite::InterpreterBuilder(model, resolver);
+
+    builder.SetNumThreads(threads);
     if (builder(&interpreter) != TfLiteStatus::kTfLiteOk) {
         std::cerr << "error: failed to create interpreter.\n";
         return nullptr;
     }
 
-    detbuilder.SetNumThreads(2);
-    builder.SetNumThreads(2);
-    interpreter->SetNumThreads(2);
-    detinterpreter->SetNumThreads(2);
-
-    detinterpreter->SetAllowFp16PrecisionForFp32(false);
+    interpreter->SetNumThreads(threads);
     interpreter->SetAllowFp16PrecisionForFp32(false);
 
-    if (detinterpreter->AllocateTensors() != kTfLiteOk) {
-        std::cerr << "error: failed to allocate det tensors.\n";
+    if (batch > 1) {
+        auto input = interpreter->inputs()[0];
+        auto* dims = interpreter->tensor(input)->dims;
+
+        std::vector<int> shape(dims->data, dims->data + dims->size);
+        shape[0] = batch;
+        if (interpreter->ResizeInputTensor(input, shape) != kTfLiteOk) {
+            std::cerr << "error: failed to resize input to batch " << batch << ".\n";
+            return nullptr;
+        }
+    }
+
+    if (delegate == nullptr) {
+        std::cerr << "error: failed to create xnnpack delegate.\n";
+        return nullptr;
+    }
+
+    if (interpreter->ModifyGraphWithDelegate(delegate) != kTfLiteOk) {
+        std::cerr << "error: failed to apply xnnpack delegate.\n";
         return nullptr;
     }
 
@@ -215,5 +226,172 @@ std::unique_ptr<InferEngine> InferEngine::create_tflite_engine() {
         return nullptr;
     }
 
-    return std::make_unique<TFLiteInferEngine>(std::move(interpreter), std::move(detinterpreter));
-}
\ No newline at end of file
+    return interpreter;
+}
+
+class TFLiteBatchDetector final : public BatchDetector {
+public:
+    TFLiteBatchDetector(int batch, std::unique_ptr<tflite::FlatBufferModel> model, TfLiteDelegatePtr delegate,
+                        std::unique_ptr<tflite::Interpreter> interpreter)
+        : m_model(std::move(model)), m_delegate(std::move(delegate)), m_interpreter(std::move(interpreter)) {
+        m_batch = batch;
+
+        auto* input = m_interpreter->typed_input_tensor<float>(0);
+        for (auto i = 0; i < batch; ++i)
+            m_inputs.emplace_back(detInputSize, detInputSize, CV_32FC3, input + static_cast<size_t>(i) * detInputSize * detInputSize * 3);
+
+        m_boxes = m_interpreter->typed_output_tensor<float>(0);
+        m_scores = m_interpreter->typed_output_tensor<float>(1);
+    }
+
+    bool invoke() override {
+        if (m_interpreter->Invoke() != kTfLiteOk) {
+            std::cerr << "error: failed to invoke interpreter.\n";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::unique_ptr<tflite::FlatBufferModel> m_model;
+    TfLiteDelegatePtr m_delegate;
+    std::unique_ptr<tflite::Interpreter> m_interpreter;
+};
+
+// static
+std::unique_ptr<BatchDetector> BatchDetector::create_tflite(int batch, const XNNPackOptions& options, ModelVariant variant) {
+    bool full = (variant == ModelVariant::Full);
+
+    auto model = tflite::FlatBufferModel::BuildFromFile(full ? TFLiteFullDetModelPath : TFLiteDetModelPath);
+    if (!model) {
+        std::cerr << "error: failed to tflite detection model\n";
+        return nullptr;
+    }
+
+    // packed weights do not depend on the batch, but the cache is keyed
+    // by the live engine's graph; do not share it.
+    auto uncached = options;
+    uncached.weight_cache = false;
+
+    auto delegate = create_xnnpack_delegate(uncached, nullptr);
+    auto interpreter = create_interpreter(*model, delegate.get(), options.threads, batch);
+    if (!interpreter)
+        return nullptr;
+
+    // a graph with a hard coded batch of 1 (e.g. in a reshape) either
+    // fails above or still puts out a single frame.
+    auto outputs_batched = [&](int index, size_t per_frame) {
+        const auto* tensor = interpreter->tensor(interpreter->outputs()[index]);
+        return tensor->dims->size > 0 && tensor->dims->data[0] == batch &&
+               tensor->bytes == per_frame * batch * sizeof(float);
+    };
+
+    if (!outputs_batched(0, detclnum * 18) || !outputs_batched(1, detclnum)) {
+        std::cerr << "error: palm detection model does not support batch " << batch << ".\n";
+        return nullptr;
+    }
+
+    return std::make_unique<TFLiteBatchDetector>(batch, std::move(model), std::move(delegate), std::move(interpreter));
+}
+
+// static
+std::unique_ptr<InferEngine> InferEngine::create_tflite_engine(const XNNPackOptions& options, ModelVariant variant) {
+    // only one of the two runs at a time, so each gets all the threads.
+    // checked first, so a missing full model does not cost a lite load.
+    if (variant == ModelVariant::Adaptive) {
+        if (access(TFLiteFullDetModelPath, R_OK) != 0 || access(TFLiteFullLandmarkModelPath, R_OK) != 0) {
+            std::cerr << "error: adaptive models need " << TFLiteFullDetModelPath << " and " << TFLiteFullLandmarkModelPath << ".\n";
+            return nullptr;
+        }
+
+        return create_adaptive_engine(create_tflite_engine(options, ModelVariant::Lite),
+                                      create_tflite_engine(options, ModelVariant::Full));
+    }
+
+    bool full = (variant == ModelVariant::Full);
+
+    using clock = std::chrono::steady_clock;
+    std::vector<StartupStep> steps;
+    auto step = [&steps](const char* name, clock::time_point begin) {
+        steps.push_back({name, std::chrono::duration<float, std::milli>(clock::now() - begin).count()});
+    };
+
+    // BuildFromFile maps the flatbuffer instead of reading it.
+    auto begin = clock::now();
+    auto detmodel = tflite::FlatBufferModel::BuildFromFile(full ? TFLiteFullDetModelPath : TFLiteDetModelPath);
+    auto model = tflite::FlatBufferModel::BuildFromFile(full ? TFLiteFullLandmarkModelPath : TFLiteLandmarkModelPath);
+    step("map models", begin);
+
+    if (!detmodel) {
+        std::cerr << "error: failed to tflite detection model\n";
+        return nullptr;
+    }
+
+    if (!model) {
+        std::cerr << "error: failed to tflite model\n";
+        return nullptr;
+    }
+
+    if (sharedAnchors() == nullptr)
+        return nullptr;
+
+    // taken in the same order by every engine, so they cannot deadlock
+    std::optional<WeightCacheFile> detcache;
+    std::optional<WeightCacheFile> cache;
+    if (options.weight_cache) {
+        begin = clock::now();
+        detcache.emplace(weight_cache_path(full ? TFLiteFullDetWeightCacheName : TFLiteDetWeightCacheName, options));
+        cache.emplace(weight_cache_path(full ? TFLiteFullLandmarkWeightCacheName : TFLiteLandmarkWeightCacheName, options));
+        step("wait for weight cache", begin);
+    }
+
+    // the delegate spawns its thread pool on creation and the threads
+    // inherit the affinity of this thread.
+    auto affinity = current_affinity();
+    pin_current_thread(options.cores);
+
+    auto detdelegate = create_xnnpack_delegate(options, detcache ? detcache->path() : nullptr);
+    auto delegate = create_xnnpack_delegate(options, cache ? cache->path() : nullptr);
+
+    if (!options.cores.empty())
+        pin_current_thread(affinity);
+
+    // applying the delegate packs the weights, so build both interpreters at once.
+
+    float det_ms = 0.0f;
+    auto detfuture = std::async(std::launch::async, [&] {
+        auto begin = clock::now();
+        auto interpreter = create_interpreter(*detmodel, detdelegate.get(), options.threads);
+        det_ms = std::chrono::duration<float, std::milli>(clock::now() - begin).count();
+        return interpreter;
+    });
+
+    begin = clock::now();
+    auto interpreter = create_interpreter(*model, delegate.get(), options.threads);
+    step("build landmark interpreter", begin);
+
+    auto detinterpreter = detfuture.get();
+    steps.push_back({"build palm interpreter", det_ms});
+
+    if (!detinterpreter || !interpreter)
+        return nullptr;
+
+    std::unique_ptr<InferEngine> engine = std::make_unique<TFLiteInferEngine>(
+        std::move(model), std::move(detmodel),
+        std::move(delegate), std::move(detdelegate),
+        std::move(interpreter), std::move(detinterpreter));
+
+    begin = clock::now();
+    if (!engine->warmup(kWarmupRuns))
+        return nullptr;
+    step("warm-up", begin);
+
+    if (detcache)
+        detcache->commit();
+    if (cache)
+        cache->commit();
+
+    engine->m_startup = std::move(steps);
+
+    return engine;
+}
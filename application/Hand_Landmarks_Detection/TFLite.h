@@ -0,0 +1,23 @@
+#pragma once
+
+#include "InferEngine.h"
+
+#include <tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h>
+#include <tensorflow/lite/interpreter.h>
+#include <tensorflow/lite/model.h>
+
+#include <memory>
+
+using TfLiteDelegatePtr = std::unique_ptr<TfLiteDelegate, decltype(&TfLiteXNNPackDelegateDelete)>;
+
+// xnnpack delegate configured by options. packed weights are cached in
+// cache_path if options.weight_cache is set; engines sharing a cache file
+// must not build it at the same time, see WeightCacheFile in TFLite.cpp.
+TfLiteDelegatePtr create_xnnpack_delegate(const XNNPackOptions& options, const char* cache_path);
+
+// interpreter of model with delegate applied and tensors allocated.
+// nullptr on failure. model and delegate must outlive it. a batch above 1
+// resizes the first input's leading dimension before the delegate is
+// applied.
+std::unique_ptr<tflite::Interpreter> create_interpreter(const tflite::FlatBufferModel& model, TfLiteDelegate* delegate, int threads,
+                                                       int batch = 1);
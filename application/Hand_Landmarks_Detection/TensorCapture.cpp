@@ -0,0 +1,162 @@
+#include "TensorCapture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        auto n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+int TensorCapture::open() {
+    close();
+
+    m_fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        std::cerr << "error: failed to open " << m_path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    // the header takes a whole page so records stay page aligned
+    std::vector<char> page(kCapturePage, 0);
+    CaptureHeader header;
+    header.header_size = kCapturePage;
+    header.record_size = kCaptureRecordSize;
+    std::memcpy(page.data(), &header, sizeof(header));
+
+    if (!write_all(m_fd, page.data(), page.size())) {
+        std::cerr << "error: failed to write " << m_path << ": " << strerror(errno) << "\n";
+        close();
+        return 1;
+    }
+
+    m_record.assign(kCaptureRecordSize, 0);
+    m_index = 0;
+    return 0;
+}
+
+void TensorCapture::close() {
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+}
+
+void TensorCapture::begin() {
+    std::fill(m_record.begin(), m_record.end(), 0);
+    record().index = m_index;
+}
+
+void TensorCapture::detector(const float* boxes, const float* scores) {
+    std::memcpy(m_record.data() + kCaptureBoxOffset, boxes, kCaptureBoxFloats * sizeof(float));
+    std::memcpy(m_record.data() + kCaptureScoreOffset, scores, kCaptureScoreFloats * sizeof(float));
+    record().flags |= kCaptureDetector;
+}
+
+void TensorCapture::landmark(const cv::Mat& input, const float* output, const float* presence) {
+    // the input is the engine's tensor, always continuous
+    std::memcpy(m_record.data() + kCaptureInputOffset, input.data, kCaptureInputFloats * sizeof(float));
+    std::memcpy(m_record.data() + kCaptureOutputOffset, output, kCaptureLandmarkFloats * sizeof(float));
+    record().flags |= kCaptureLandmark;
+
+    if (presence != nullptr) {
+        record().presence = *presence;
+        record().flags |= kCapturePresence;
+    }
+}
+
+void TensorCapture::end(bool detected, const std::vector<cv::Point2f>& landmarks) {
+    if (m_fd < 0)
+        return;
+
+    if (detected) {
+        record().flags |= kCaptureDetected;
+
+        auto count = std::min<size_t>(landmarks.size(), std::size(record().landmarks));
+        for (size_t i = 0; i < count; ++i) {
+            record().landmarks[i][0] = landmarks[i].x;
+            record().landmarks[i][1] = landmarks[i].y;
+        }
+    }
+
+    if (!write_all(m_fd, m_record.data(), m_record.size())) {
+        std::cerr << "error: failed to write " << m_path << ": " << strerror(errno) << "\n";
+        close();
+        return;
+    }
+
+    m_index += 1;
+}
+
+bool CaptureReader::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < static_cast<off_t>(kCapturePage)) {
+        ::close(fd);
+        return false;
+    }
+
+    // private, so a replay can never write back into the capture
+    auto* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+        return false;
+
+    m_memory = memory;
+    m_length = info.st_size;
+
+    const auto* header = static_cast<const CaptureHeader*>(m_memory);
+    if (header->magic != kCaptureMagic || header->version != kCaptureVersion ||
+        header->header_size != kCapturePage || header->record_size != kCaptureRecordSize ||
+        header->box_floats != kCaptureBoxFloats || header->score_floats != kCaptureScoreFloats ||
+        header->input_floats != kCaptureInputFloats || header->landmark_floats != kCaptureLandmarkFloats) {
+        close();
+        return false;
+    }
+
+    // replays read front to back
+    madvise(m_memory, m_length, MADV_SEQUENTIAL);
+
+    m_count = (m_length - kCapturePage) / kCaptureRecordSize;
+    return true;
+}
+
+void CaptureReader::close() {
+    if (m_memory != nullptr)
+        munmap(m_memory, m_length);
+    m_memory = nullptr;
+    m_length = 0;
+    m_count = 0;
+}
+
+CaptureReader::View CaptureReader::at(size_t index) const {
+    const auto* base = static_cast<const char*>(m_memory) + kCapturePage + index * kCaptureRecordSize;
+
+    View view;
+    view.record = reinterpret_cast<const CaptureRecord*>(base);
+    view.boxes = reinterpret_cast<const float*>(base + kCaptureBoxOffset);
+    view.scores = reinterpret_cast<const float*>(base + kCaptureScoreOffset);
+    view.input = reinterpret_cast<const float*>(base + kCaptureInputOffset);
+    view.output = reinterpret_cast<const float*>(base + kCaptureOutputOffset);
+    return view;
+}
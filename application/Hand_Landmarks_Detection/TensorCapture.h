@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Defs.h"
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Raw model tensors of every do_infer(), for replaying the post-processing
+// without a model. See InferEngine::set_capture() and
+// InferEngine::create_replay_engine().
+//
+// A capture file is a CaptureHeader followed by fixed-size records, each
+// padded to whole pages so a mapped record's tensors are aligned:
+//
+//   CaptureRecord
+//   detector boxes    detclnum x 18 floats, as the model output them
+//   detector scores   detclnum floats, logits
+//   landmark input    kInputSize x kInputSize x 3 floats
+//   landmark output   kCaptureLandmarkFloats floats
+//
+// Tensors of a model that did not run on that frame are zero.
+
+constexpr uint32_t kCaptureMagic = 0x484e5443;
+constexpr uint32_t kCaptureVersion = 1;
+constexpr size_t kCapturePage = 4096;
+
+constexpr size_t kCaptureBoxFloats = detclnum * 18;
+constexpr size_t kCaptureScoreFloats = detclnum;
+constexpr size_t kCaptureInputFloats = kInputSize * kInputSize * 3;
+constexpr size_t kCaptureLandmarkFloats = 21 * 3;
+
+enum CaptureFlags : uint32_t {
+    kCaptureDetector = 1,  // the palm detector ran
+    kCaptureLandmark = 2,  // the landmark model ran
+    kCapturePresence = 4,  // presence holds the landmark model's hand flag
+    kCaptureDetected = 8,  // do_infer() returned true; landmarks are valid
+};
+
+struct CaptureHeader {
+    uint32_t magic = kCaptureMagic;
+    uint32_t version = kCaptureVersion;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t box_floats = kCaptureBoxFloats;
+    uint32_t score_floats = kCaptureScoreFloats;
+    uint32_t input_floats = kCaptureInputFloats;
+    uint32_t landmark_floats = kCaptureLandmarkFloats;
+};
+
+struct CaptureRecord {
+    int64_t index;              // do_infer() calls since the capture started
+    uint32_t flags;             // CaptureFlags
+    float presence;
+    float landmarks[21][2];     // precise landmarks the engine computed from these tensors
+};
+
+// offsets into a record
+constexpr size_t kCaptureBoxOffset = (sizeof(CaptureRecord) + 63) / 64 * 64;
+constexpr size_t kCaptureScoreOffset = kCaptureBoxOffset + kCaptureBoxFloats * sizeof(float);
+constexpr size_t kCaptureInputOffset = kCaptureScoreOffset + kCaptureScoreFloats * sizeof(float);
+constexpr size_t kCaptureOutputOffset = kCaptureInputOffset + kCaptureInputFloats * sizeof(float);
+constexpr size_t kCaptureRecordSize =
+    (kCaptureOutputOffset + kCaptureLandmarkFloats * sizeof(float) + kCapturePage - 1) / kCapturePage * kCapturePage;
+
+// Appends records while an engine infers. Not thread safe; owned by the
+// thread running the engine.
+class TensorCapture final {
+public:
+    explicit TensorCapture(std::string path)
+        : m_path(std::move(path)) {}
+
+    TensorCapture(const TensorCapture&) = delete;
+    TensorCapture& operator=(const TensorCapture&) = delete;
+
+    ~TensorCapture() noexcept { close(); }
+
+    int open();
+    void close();
+
+    int64_t records() const { return m_index; }
+
+    // called by the engine around and inside do_infer().
+    void begin();
+    void detector(const float* boxes, const float* scores);
+    void landmark(const cv::Mat& input, const float* output, const float* presence);
+    void end(bool detected, const std::vector<cv::Point2f>& landmarks);
+
+private:
+    std::string m_path;
+    int m_fd = -1;
+    int64_t m_index = 0;
+    std::vector<char> m_record;  // kCaptureRecordSize, filled during do_infer()
+
+    CaptureRecord& record() { return *reinterpret_cast<CaptureRecord*>(m_record.data()); }
+};
+
+// Maps a capture file for reading.
+class CaptureReader final {
+public:
+    // one record's tensors, pointing into the mapping.
+    struct View {
+        const CaptureRecord* record;
+        const float* boxes;
+        const float* scores;
+        const float* input;
+        const float* output;
+    };
+
+    CaptureReader() = default;
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    ~CaptureReader() noexcept { close(); }
+
+    // false if path is not a capture of this build's tensor sizes.
+    bool open(const std::string& path);
+    void close();
+
+    size_t size() const { return m_count; }
+    View at(size_t index) const;
+
+private:
+    void* m_memory = nullptr;
+    size_t m_length = 0;
+    size_t m_count = 0;
+};
@@ -0,0 +1,64 @@
+#include "ThreadBudget.h"
+#include "Affinity.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+ThreadBudget::ThreadBudget(int cores)
+    : m_cores(cores > 0 ? cores : std::max<int>(1, current_affinity().size())) {}
+
+ThreadPlan ThreadBudget::plan(int engines) const {
+    ThreadPlan plan;
+    plan.cores = m_cores;
+    plan.engines = std::max(1, engines);
+
+    auto available = std::max(1, m_cores - kReservedCores);
+    plan.engine_threads = std::max(1, available / plan.engines);
+    plan.opencv_threads = plan.engine_threads;
+
+    // an idle spinning worker burns its core, so only spin when every
+    // worker has one to itself.
+    plan.spin = plan.engines * plan.engine_threads + kReservedCores <= m_cores;
+
+    return plan;
+}
+
+void ThreadBudget::apply(const ThreadPlan& plan) {
+    cv::setNumThreads(plan.opencv_threads);
+
+    track("io (main, capture, display)", kReservedCores);
+    // opencv threads only add up when its pool is wider than the engine's.
+    if (plan.opencv_threads > plan.engine_threads)
+        track("opencv", plan.opencv_threads - plan.engine_threads);
+    else
+        untrack("opencv");
+}
+
+void ThreadBudget::track(const std::string& name, int threads) {
+    std::unique_lock lock(m_lock);
+    m_threads[name] = threads;
+}
+
+void ThreadBudget::untrack(const std::string& name) {
+    std::unique_lock lock(m_lock);
+    m_threads.erase(name);
+}
+
+int ThreadBudget::report() const {
+    std::unique_lock lock(m_lock);
+
+    int total = 0;
+    std::cerr << "thread budget: " << m_cores << " cores, opencv " << cv::getNumThreads() << " threads\n";
+    for (const auto& [name, threads] : m_threads) {
+        std::cerr << "  - " << name << ": " << threads << "\n";
+        total += threads;
+    }
+
+    auto over = std::max(0, total - m_cores);
+    if (over > 0)
+        std::cerr << "warning: " << total << " runnable threads on " << m_cores << " cores, expect latency spikes.\n";
+
+    return over;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Defs.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+// How the cores are split for a run with some number of engines inferring
+// at the same time.
+struct ThreadPlan {
+    int cores = 1;
+    int engines = 1;
+    int engine_threads = 1;  // per engine, including the worker invoking it
+    int opencv_threads = 1;  // preprocessing runs on the worker between models
+    bool spin = false;       // workers own a core and may busy-wait for frames
+};
+
+// Process wide CPU budget shared by TFLite, Optimium and OpenCV.
+//
+// kReservedCores are left to the main, capture and display threads; the
+// rest is divided between the engines. The two models of an engine and
+// the preprocessing before them run one after another on the same worker,
+// so they share that worker's share instead of adding up.
+class ThreadBudget final {
+public:
+    // cores defaults to the cores this process may run on.
+    explicit ThreadBudget(int cores = 0);
+
+    int cores() const { return m_cores; }
+
+    ThreadPlan plan(int engines) const;
+
+    // size OpenCV's pool to the plan.
+    void apply(const ThreadPlan& plan);
+
+    // runnable threads a component may have at once. replaces an earlier
+    // entry of the same name.
+    void track(const std::string& name, int threads);
+
+    void untrack(const std::string& name);
+
+    // print tracked threads against the cores. returns the number of
+    // threads beyond the cores, 0 if not oversubscribed.
+    int report() const;
+
+private:
+    int m_cores;
+
+    mutable std::mutex m_lock;
+    std::map<std::string, int> m_threads;
+};
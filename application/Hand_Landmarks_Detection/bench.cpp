@@ -0,0 +1,421 @@
+// Microbenchmarks of the post-processing kernels in Postprocess.cpp and nms.cpp.
+//
+// Runs each kernel in isolation on synthetic detector outputs, and on
+// recorded ones if --dump is given, once per OpenCV thread count. Only the
+// OpenCV backed kernels (affine matrix, warp, projection) use the threads,
+// the rest show the single core cost in both runs.
+//
+// A dump holds raw palm detector outputs, frame after frame: detclnum x 18
+// box floats followed by detclnum score floats. A tensor capture (see
+// TensorCapture.h) works too; its frames where the detector ran are used.
+
+#include "Defs.h"
+#include "Postprocess.h"
+#include "LatencyWindow.h"
+#include "TensorCapture.h"
+#include "nms.h"
+#include "ParseNumber.h"
+
+#include <opencv2/core.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const auto usage = R"(usage: rpi-bench [options]
+  --dump FILE       also run on recorded detector outputs
+  --threads LIST    comma separated OpenCV thread counts (default: 1,4)
+  --samples N       timed samples per kernel (default: 30)
+  --csv FILE        append results as csv for tracking
+)";
+
+constexpr size_t kBoxFloats = detclnum * 18;
+constexpr size_t kFrameFloats = kBoxFloats + detclnum;
+
+using steady = std::chrono::steady_clock;
+
+// one set of raw detector outputs.
+struct DetectorFrame {
+    std::vector<float> boxes;   // kBoxFloats
+    std::vector<float> scores;  // detclnum, logits
+};
+
+struct Scenario {
+    std::string name;
+    std::vector<DetectorFrame> frames;
+};
+
+struct Row {
+    std::string scenario;
+    std::string kernel;
+    int threads;
+    float median_us;
+    float p99_us;
+};
+
+// keeps results observable so the compiler cannot drop the work.
+volatile float sink;
+
+// anchors are laid out on the 24x24 and 12x12 grids of the palm model, so
+// offsets around a center pixel map back through the anchor positions.
+DetectorFrame synthesize(const float* anchors, int hands, int hot_anchors, std::mt19937& rng) {
+    std::normal_distribution<float> jitter(0.0f, 2.0f);
+    std::uniform_int_distribution<int> pick(0, detclnum - 1);
+
+    DetectorFrame frame;
+    frame.boxes.assign(kBoxFloats, 0.0f);
+    frame.scores.assign(detclnum, -8.0f);
+
+    for (auto h = 0; h < hands; ++h) {
+        auto center = pick(rng);
+        float cx = anchors[center * 4] * detInputSize;
+        float cy = anchors[center * 4 + 1] * detInputSize;
+        float side = 40.0f + 10.0f * h;
+
+        // the hand lights up every anchor nearby, all predicting about the
+        // same box. that is the case nms has to do the real work in.
+        for (auto n = 0, i = 0; n < hot_anchors && i < detclnum; ++i) {
+            float ax = anchors[i * 4] * detInputSize;
+            float ay = anchors[i * 4 + 1] * detInputSize;
+            if (std::abs(ax - cx) > side || std::abs(ay - cy) > side)
+                continue;
+
+            float* box = &frame.boxes[i * 18];
+            box[0] = cx - ax + jitter(rng);
+            box[1] = cy - ay + jitter(rng);
+            box[2] = side + jitter(rng);
+            box[3] = side + jitter(rng);
+
+            // wrist below, fingers above the center
+            for (auto k = 0; k < 7; ++k) {
+                box[4 + k * 2] = box[0] + (k - 3) * side / 8.0f + jitter(rng);
+                box[5 + k * 2] = box[1] + (k == 0 ? side / 2.0f : -side / 3.0f) + jitter(rng);
+            }
+
+            frame.scores[i] = 2.0f + jitter(rng);
+            ++n;
+        }
+    }
+
+    return frame;
+}
+
+bool load_dump(const std::string& path, std::vector<DetectorFrame>& frames) {
+    if (CaptureReader capture; capture.open(path)) {
+        for (size_t i = 0; i < capture.size(); ++i) {
+            auto record = capture.at(i);
+            if (!(record.record->flags & kCaptureDetector))
+                continue;
+
+            DetectorFrame frame;
+            frame.boxes.assign(record.boxes, record.boxes + kBoxFloats);
+            frame.scores.assign(record.scores, record.scores + detclnum);
+            frames.push_back(std::move(frame));
+        }
+
+        if (frames.empty()) {
+            std::cerr << "error: " << path << " has no detector outputs.\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "error: failed to open " << path << ".\n";
+        return false;
+    }
+
+    for (;;) {
+        DetectorFrame frame;
+        frame.boxes.resize(kBoxFloats);
+        frame.scores.resize(detclnum);
+
+        if (!file.read(reinterpret_cast<char*>(frame.boxes.data()), kBoxFloats * sizeof(float)) ||
+            !file.read(reinterpret_cast<char*>(frame.scores.data()), detclnum * sizeof(float)))
+            break;
+
+        frames.push_back(std::move(frame));
+    }
+
+    if (frames.empty()) {
+        std::cerr << "error: " << path << " has no complete frame of " << kFrameFloats * sizeof(float) << " bytes.\n";
+        return false;
+    }
+
+    return true;
+}
+
+// median and p99 per call over samples, each sample long enough to be
+// well above the clock resolution.
+void measure(const std::string& kernel, const Scenario& scenario, int threads, int samples,
+             const std::function<void(size_t)>& fn, std::vector<Row>& rows) {
+    // calibrate to ~1ms per sample
+    size_t iterations = 1;
+    for (;;) {
+        auto begin = steady::now();
+        for (size_t i = 0; i < iterations; ++i)
+            fn(i);
+        if (steady::now() - begin > std::chrono::milliseconds(1) || iterations >= (1u << 20))
+            break;
+        iterations *= 2;
+    }
+
+    LatencyWindow window(samples);
+    for (auto s = 0; s < samples; ++s) {
+        auto begin = steady::now();
+        for (size_t i = 0; i < iterations; ++i)
+            fn(i);
+        auto elapsed = std::chrono::duration<float, std::micro>(steady::now() - begin).count();
+        window.add(elapsed / iterations);
+    }
+
+    rows.push_back({scenario.name, kernel, threads, window.percentile(50), window.percentile(99)});
+}
+
+void run_scenario(const Scenario& scenario, const float* anchors, int threads, int samples, std::vector<Row>& rows) {
+    const auto& frames = scenario.frames;
+    auto frame_at = [&frames](size_t i) -> const DetectorFrame& { return frames[i % frames.size()]; };
+
+    // sigmoid_score: in place, its cost does not depend on the values
+    std::vector<float> scores = frames.front().scores;
+    measure("sigmoid_score", scenario, threads, samples, [&](size_t) {
+        sigmoid_score(scores.data());
+        sink = scores[0];
+    }, rows);
+
+    // decodeBoundingBoxes
+    std::vector<float> decoded(kBoxFloats);
+    measure("decodeBoundingBoxes", scenario, threads, samples, [&](size_t i) {
+        decodeBoundingBoxes(decoded.data(), frame_at(i).boxes.data(), anchors);
+        sink = decoded[0];
+    }, rows);
+
+    // decoded boxes and candidates of every frame, as select_palm builds them
+    std::vector<std::vector<float>> decoded_frames(frames.size(), std::vector<float>(kBoxFloats));
+    std::vector<std::vector<BoundBox>> candidates(frames.size());
+    std::vector<std::vector<float>> probabilities(frames.size());
+    size_t total_candidates = 0;
+
+    for (size_t f = 0; f < frames.size(); ++f) {
+        decodeBoundingBoxes(decoded_frames[f].data(), frames[f].boxes.data(), anchors);
+        std::vector<float> probs = frames[f].scores;
+        sigmoid_score(probs.data());
+
+        for (auto i = 0; i < detclnum; ++i) {
+            if (probs[i] <= confidenceThreshold)
+                continue;
+            candidates[f].emplace_back(decoded_frames[f].data() + i * 18);
+            probabilities[f].push_back(probs[i]);
+        }
+        total_candidates += candidates[f].size();
+    }
+
+    std::cout << scenario.name << ": " << frames.size() << " frame(s), "
+              << total_candidates / frames.size() << " candidate(s) per frame\n";
+
+    measure("nonMaximumSuppression", scenario, threads, samples, [&](size_t i) {
+        auto f = i % frames.size();
+        auto picked = nonMaximumSuppression(candidates[f], probabilities[f]);
+        sink = picked.size();
+    }, rows);
+
+    // the rest needs a detected palm
+    std::vector<BoundBox> palms;
+    std::vector<cv::Point2f> offsets;
+    for (size_t f = 0; f < frames.size(); ++f) {
+        auto picked = nonMaximumSuppression(candidates[f], probabilities[f]);
+        if (picked.empty())
+            continue;
+
+        auto index = (candidates[f][picked[0]].ptr - decoded_frames[f].data()) / 18;
+        palms.push_back(candidates[f][picked[0]]);
+        offsets.emplace_back(anchors[index * 4] * detInputSize, anchors[index * 4 + 1] * detInputSize);
+    }
+
+    if (palms.empty()) {
+        std::cout << scenario.name << ": no palm above threshold, skipping crop and projection kernels.\n";
+        return;
+    }
+
+    float scale = static_cast<float>(std::max(kWidth, kHeight)) / detInputSize;
+
+    measure("extractHandDetails", scenario, threads, samples, [&](size_t i) {
+        auto [triangle, keypoints] = extractHandDetails(palms[i % palms.size()], offsets[i % palms.size()]);
+        sink = triangle[0].x;
+    }, rows);
+
+    std::vector<cv::Mat> affines;
+    for (size_t p = 0; p < palms.size(); ++p) {
+        auto [triangle, keypoints] = extractHandDetails(palms[p], offsets[p]);
+        affines.push_back(computeAffineMatrix(triangle, scale));
+    }
+
+    measure("computeAffineMatrix", scenario, threads, samples, [&](size_t i) {
+        auto [triangle, keypoints] = extractHandDetails(palms[i % palms.size()], offsets[i % palms.size()]);
+        auto affine = computeAffineMatrix(triangle, scale);
+        sink = affine.at<double>(0, 0);
+    }, rows);
+
+    // padded RGB frame the hand is cropped from
+    cv::Mat padded(kWidth, kWidth, CV_8UC3);
+    cv::randu(padded, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::Mat crop(kInputSize, kInputSize, CV_32FC3);
+
+    measure("warpHandRegion", scenario, threads, samples, [&](size_t i) {
+        warpHandRegion(padded, affines[i % affines.size()], crop);
+        sink = crop.at<float>(0, 0);
+    }, rows);
+
+    std::vector<float> raw_landmarks(21 * 3);
+    for (auto j = 0; j < 21; ++j) {
+        raw_landmarks[j * 3] = 40.0f + 7.0f * (j % 5);
+        raw_landmarks[j * 3 + 1] = 40.0f + 30.0f * (j / 5);
+        raw_landmarks[j * 3 + 2] = 0.0f;
+    }
+
+    std::vector<cv::Mat> inverses;
+    for (const auto& affine : affines) {
+        cv::Mat paddedMatrix = cv::Mat::eye(3, 3, CV_32F);
+        affine.convertTo(paddedMatrix(cv::Rect(0, 0, 3, 2)), CV_32F);
+        inverses.push_back(paddedMatrix.inv());
+    }
+
+    cv::Size padding(detPadHeight, detPadWidth);
+    measure("projectLandmarksToOriginal", scenario, threads, samples, [&](size_t i) {
+        auto joints = extractLandmarks(raw_landmarks.data());
+        auto points = projectLandmarksToOriginal(joints, inverses[i % inverses.size()], padding);
+        sink = points[0].x;
+    }, rows);
+}
+
+void print_rows(const std::vector<Row>& rows) {
+    std::cout << std::left << std::setw(10) << "scenario" << std::setw(30) << "kernel" << std::right
+              << std::setw(8) << "threads" << std::setw(14) << "median(us)" << std::setw(12) << "p99(us)" << "\n";
+
+    for (const auto& row : rows) {
+        std::cout << std::left << std::setw(10) << row.scenario << std::setw(30) << row.kernel << std::right
+                  << std::setw(8) << row.threads << std::fixed << std::setprecision(3)
+                  << std::setw(14) << row.median_us << std::setw(12) << row.p99_us << "\n";
+    }
+}
+
+bool write_csv(const std::string& path, const std::vector<Row>& rows) {
+    bool exists = std::ifstream(path).good();
+    std::ofstream file(path, std::ios::app);
+    if (!file.is_open()) {
+        std::cerr << "error: failed to open " << path << ".\n";
+        return false;
+    }
+
+    if (!exists)
+        file << "timestamp,scenario,kernel,threads,median_us,p99_us\n";
+
+    auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    for (const auto& row : rows) {
+        file << timestamp << ',' << row.scenario << ',' << row.kernel << ',' << row.threads << ','
+             << row.median_us << ',' << row.p99_us << '\n';
+    }
+
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string dump;
+    std::string csv;
+    std::vector<int> thread_counts = {1, 4};
+    int samples = 30;
+
+    for (auto i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << usage;
+            return 2;
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--dump") {
+            dump = value;
+        } else if (arg == "--csv") {
+            csv = value;
+        } else if (arg == "--samples") {
+            if (!parse_number(value, samples)) {
+                std::cerr << "error: invalid value " << value << " for " << arg << ".\n" << usage;
+                return 2;
+            }
+            samples = std::max(1, samples);
+        } else if (arg == "--threads") {
+            thread_counts.clear();
+            std::stringstream stream(value);
+            std::string text;
+            while (std::getline(stream, text, ',')) {
+                int count = 0;
+                if (!parse_number(text, count)) {
+                    std::cerr << "error: invalid value " << value << " for " << arg << ".\n" << usage;
+                    return 2;
+                }
+                thread_counts.push_back(std::max(1, count));
+            }
+            if (thread_counts.empty()) {
+                std::cerr << "error: no thread count in " << arg << ".\n" << usage;
+                return 2;
+            }
+        } else {
+            std::cerr << usage;
+            return 2;
+        }
+    }
+
+    const float* anchors = sharedAnchors();
+    if (anchors == nullptr)
+        return 2;
+
+    std::mt19937 rng(42);
+    std::vector<Scenario> scenarios;
+
+    // nothing in view: every score below the threshold
+    scenarios.push_back({"empty", {synthesize(anchors, 0, 0, rng)}});
+    // a typical hand: a few dozen anchors fire on it
+    scenarios.push_back({"one-hand", {}});
+    for (auto i = 0; i < 8; ++i)
+        scenarios.back().frames.push_back(synthesize(anchors, 1, 40, rng));
+    // worst case for nms: two hands, hundreds of overlapping anchors
+    scenarios.push_back({"crowded", {}});
+    for (auto i = 0; i < 8; ++i)
+        scenarios.back().frames.push_back(synthesize(anchors, 2, 300, rng));
+
+    if (!dump.empty()) {
+        Scenario recorded{"recorded", {}};
+        if (!load_dump(dump, recorded.frames))
+            return 2;
+        scenarios.push_back(std::move(recorded));
+    }
+
+    std::vector<Row> rows;
+    for (auto threads : thread_counts) {
+        cv::setNumThreads(threads);
+        for (const auto& scenario : scenarios)
+            run_scenario(scenario, anchors, threads, samples, rows);
+    }
+
+    print_rows(rows);
+
+    if (!csv.empty() && !write_csv(csv, rows))
+        return 2;
+
+    return 0;
+}
@@ -0,0 +1,528 @@
+// Headless inference service.
+//
+// Listens on a Unix socket so several local processes share one set of
+// warm engines instead of each loading their own. Clients attach memfd (or
+// any mappable) buffers once and then submit frames by offset; results
+// come back asynchronously on the same socket. See ServiceProtocol.h.
+//
+// Each client is a stream of the StreamServer: it keeps only its newest
+// frame, and ready clients are served back to back by the engine pool, so
+// a burst from many clients keeps every engine busy without one client
+// starving the others.
+
+#include "InferEngine.h"
+#include "Defs.h"
+#include "EngineProvider.h"
+#include "ServiceProtocol.h"
+#include "StreamServer.h"
+#include "ThreadBudget.h"
+#include "ParseNumber.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const auto usage = R"(usage: rpi-daemon [options]
+  --socket PATH      socket to listen on (default: /tmp/rpi-daemon.sock)
+  --engine KIND      tflite or optimium (default: optimium)
+  --engines N        engines in the pool (default: from the thread budget)
+  --deadline MS      drop frames queued longer than this (default: 100)
+)";
+
+using clock = StreamServer::clock;
+
+struct Options {
+    std::string socket = service::kDefaultSocket;
+    Kind kind = Kind::Optimium;
+    int engines = 0;
+    int deadline = kStreamDeadlineMS;
+};
+
+struct Mapping {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+// a connection. its index is its stream in the server.
+struct Connection {
+    int fd = -1;
+    uint64_t generation = 0;  // tells a reconnect apart from the old client
+    std::map<uint32_t, Mapping> buffers;
+};
+
+// a submitted frame not answered yet.
+struct Pending {
+    int stream;
+    uint64_t generation;
+    uint64_t id;
+};
+
+// results handed from the workers to the socket loop.
+struct Completed {
+    StreamServer::Outcome outcome;
+    StreamServer::Result result;
+};
+
+std::atomic<bool> g_run = true;
+
+void on_signal(int) {
+    g_run = false;
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (auto i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (i + 1 >= argc) {
+            std::cerr << "error: missing value for " << arg << ".\n";
+            return false;
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--socket") {
+            options.socket = value;
+        } else if (arg == "--engine") {
+            if (value == "tflite") options.kind = Kind::TFLite;
+            else if (value == "optimium") options.kind = Kind::Optimium;
+            else {
+                std::cerr << "error: unknown engine " << value << ".\n";
+                return false;
+            }
+        } else if (arg == "--engines" && parse_number(value, options.engines)) {
+            options.engines = std::max(1, options.engines);
+        } else if (arg == "--deadline" && parse_number(value, options.deadline)) {
+            options.deadline = std::max(1, options.deadline);
+        } else if (arg == "--engines" || arg == "--deadline") {
+            std::cerr << "error: invalid value " << value << " for " << arg << ".\n";
+            return false;
+        } else {
+            std::cerr << "error: unknown option " << arg << ".\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int listen_on(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "error: failed to create socket: " << strerror(errno) << "\n";
+        return -1;
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "error: socket path too long: " << path << "\n";
+        close(fd);
+        return -1;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    // a socket file left behind by an earlier run
+    unlink(path.c_str());
+
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, kMaxStreams) < 0) {
+        std::cerr << "error: failed to listen on " << path << ": " << strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void unmap(Mapping& mapping) {
+    if (mapping.data != nullptr)
+        munmap(const_cast<unsigned char*>(mapping.data), mapping.size);
+    mapping = {};
+}
+
+void disconnect(Connection& connection) {
+    for (auto& [id, mapping] : connection.buffers)
+        unmap(mapping);
+    connection.buffers.clear();
+
+    close(connection.fd);
+    connection.fd = -1;
+    connection.generation += 1;
+}
+
+void send_result(const Connection& connection, service::Status status, uint64_t id,
+                 const StreamServer::Result* result = nullptr) {
+    service::ResultMessage message;
+    message.status = status;
+    message.id = id;
+    message.result.frame = -1;
+
+    if (result != nullptr) {
+        auto& out = message.result;
+        out.frame = result->sequence;
+        out.detected = result->detected;
+
+        out.box_count = std::min<uint32_t>(result->boxes.size(), result_ring::kMaxBoxes);
+        for (uint32_t i = 0; i < out.box_count; ++i) {
+            const auto& box = result->boxes[i];
+            out.boxes[i][0] = box.x;
+            out.boxes[i][1] = box.y;
+            out.boxes[i][2] = box.width;
+            out.boxes[i][3] = box.height;
+        }
+
+        if (result->detected) {
+            auto count = std::min<size_t>(result->precise_landmarks.size(), result_ring::kLandmarks);
+            for (size_t i = 0; i < count; ++i) {
+                out.landmarks[i][0] = result->precise_landmarks[i].x;
+                out.landmarks[i][1] = result->precise_landmarks[i].y;
+            }
+        }
+    }
+
+    // a client that stopped reading loses results rather than stalling
+    // everyone else.
+    if (send(connection.fd, &message, sizeof(message), MSG_NOSIGNAL | MSG_DONTWAIT) != static_cast<ssize_t>(sizeof(message)) &&
+        errno != EAGAIN) {
+        std::cerr << "warning: failed to send result: " << strerror(errno) << "\n";
+    }
+}
+
+// receive an attach message and the descriptor that comes with it.
+void handle_attach(Connection& connection, const service::AttachMessage& message, int fd) {
+    if (fd < 0) {
+        std::cerr << "warning: attach without a descriptor.\n";
+        return;
+    }
+
+    // a client shrinking the file under the mapping would crash the
+    // daemon with SIGBUS, so only memfds sealed against it are mapped.
+    // other files cannot be sealed and fail F_GET_SEALS.
+    struct stat info;
+    auto seals = fcntl(fd, F_GET_SEALS);
+    if (fstat(fd, &info) < 0 || static_cast<uint64_t>(info.st_size) < message.size ||
+        seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        std::cerr << "warning: buffer " << message.buffer << " is smaller than announced or not sealed.\n";
+        close(fd);
+        return;
+    }
+
+    auto* data = mmap(nullptr, message.size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        std::cerr << "warning: failed to map buffer " << message.buffer << ": " << strerror(errno) << "\n";
+        return;
+    }
+
+    auto& mapping = connection.buffers[message.buffer];
+    unmap(mapping);
+    mapping.data = static_cast<const unsigned char*>(data);
+    mapping.size = message.size;
+}
+
+bool valid_frame(const Connection& connection, const service::FrameMessage& frame) {
+    auto it = connection.buffers.find(frame.buffer);
+    if (it == connection.buffers.end())
+        return false;
+
+    if (frame.format != service::PixelFormat::BGR24 || frame.width != kWidth || frame.height != kHeight ||
+        frame.stride < frame.width * 3)
+        return false;
+
+    auto end = frame.offset + static_cast<uint64_t>(frame.stride) * (frame.height - 1) + frame.width * 3;
+    return end <= it->second.size;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    // one engine per kEngineThreads cores of the budget unless told.
+    ThreadBudget budget;
+    auto pool_size = (options.engines > 0)
+        ? options.engines
+        : std::clamp<int>((budget.cores() - kReservedCores) / kEngineThreads, 1, kMaxStreams);
+    auto plan = budget.plan(pool_size);
+    budget.apply(plan);
+
+    std::vector<std::unique_ptr<InferEngine>> engines;
+    std::vector<InferEngine*> pool;
+    for (auto i = 0; i < pool_size; ++i) {
+        std::unique_ptr<InferEngine> engine;
+        if (options.kind == Kind::TFLite) {
+            XNNPackOptions xnnpack;
+            xnnpack.threads = plan.engine_threads;
+            engine = InferEngine::create_tflite_engine(xnnpack);
+        } else {
+            engine = InferEngine::create_optimium_engine(plan.engine_threads);
+        }
+
+        if (!engine)
+            return 1;
+
+        pool.push_back(engine.get());
+        engines.push_back(std::move(engine));
+    }
+
+    budget.track("engine", pool_size * plan.engine_threads);
+    budget.report();
+
+    // workers hand results over to the socket loop, which owns every fd.
+    int wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    std::mutex completed_lock;
+    std::deque<Completed> completed;
+
+    StreamServer server(pool, kMaxStreams, std::chrono::milliseconds(options.deadline));
+    server.set_completion([&](int, StreamServer::Outcome outcome, const StreamServer::Result& result) {
+        {
+            std::unique_lock lock(completed_lock);
+            completed.push_back({outcome, result});
+        }
+
+        uint64_t one = 1;
+        if (write(wakeup, &one, sizeof(one)) < 0)
+            std::cerr << "warning: failed to wake the socket loop.\n";
+    });
+
+    int listener = listen_on(options.socket);
+    if (listener < 0 || wakeup < 0)
+        return 1;
+
+    if (server.start())
+        return 1;
+
+    std::cerr << "serving " << to_string(options.kind) << " on " << options.socket << " with " << pool_size
+              << " engines.\n";
+
+    std::vector<Connection> connections(kMaxStreams);
+    std::unordered_map<int64_t, Pending> pending;
+    int64_t next_tag = 0;
+
+    std::vector<pollfd> events;
+    std::deque<Completed> ready;
+
+    while (g_run) {
+        events.clear();
+        events.push_back({listener, POLLIN, 0});
+        events.push_back({wakeup, POLLIN, 0});
+        for (const auto& connection : connections)
+            events.push_back({connection.fd, POLLIN, 0});
+
+        if (poll(events.data(), events.size(), 200) < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "error: poll failed: " << strerror(errno) << "\n";
+            break;
+        }
+
+        // results first, so their buffers are free to reuse before new
+        // frames are read.
+        if (events[1].revents & POLLIN) {
+            uint64_t count;
+            while (read(wakeup, &count, sizeof(count)) > 0)
+                ;
+
+            {
+                std::unique_lock lock(completed_lock);
+                std::swap(ready, completed);
+            }
+
+            for (const auto& [outcome, result] : ready) {
+                auto it = pending.find(result.tag);
+                if (it == pending.end())
+                    continue;
+
+                auto request = it->second;
+                pending.erase(it);
+
+                auto& connection = connections[request.stream];
+                if (connection.fd < 0 || connection.generation != request.generation)
+                    continue; // the client left meanwhile
+
+                switch (outcome) {
+                    case StreamServer::Outcome::Inferred:
+                        send_result(connection, service::Status::Inferred, request.id, &result);
+                        break;
+                    case StreamServer::Outcome::Replaced:
+                        send_result(connection, service::Status::Replaced, request.id);
+                        break;
+                    case StreamServer::Outcome::Expired:
+                        send_result(connection, service::Status::Expired, request.id);
+                        break;
+                }
+            }
+            ready.clear();
+        }
+
+        if (events[0].revents & POLLIN) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            auto slot = std::find_if(connections.begin(), connections.end(), [](const Connection& c) { return c.fd < 0; });
+
+            if (fd >= 0 && slot == connections.end()) {
+                Connection rejected;
+                rejected.fd = fd;
+                send_result(rejected, service::Status::Busy, 0);
+                close(fd);
+            } else if (fd >= 0) {
+                slot->fd = fd;
+            }
+        }
+
+        for (size_t i = 0; i < connections.size(); ++i) {
+            auto& connection = connections[i];
+            auto revents = events[i + 2].revents;
+            if (connection.fd < 0 || revents == 0)
+                continue;
+
+            if (!(revents & POLLIN)) {
+                disconnect(connection);
+                continue;
+            }
+
+            // large enough for any message; the type tells which one.
+            alignas(8) char message[sizeof(service::FrameMessage)];
+
+            char control[CMSG_SPACE(sizeof(int))] = {};
+            iovec data{ message, sizeof(message) };
+
+            msghdr header{};
+            header.msg_iov = &data;
+            header.msg_iovlen = 1;
+            header.msg_control = control;
+            header.msg_controllen = sizeof(control);
+
+            auto received = recvmsg(connection.fd, &header, MSG_CMSG_CLOEXEC);
+            if (received <= 0) {
+                disconnect(connection);
+                continue;
+            }
+
+            int passed = -1;
+            if (auto* cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr && cmsg->cmsg_type == SCM_RIGHTS)
+                std::memcpy(&passed, CMSG_DATA(cmsg), sizeof(int));
+
+            service::MessageHeader type;
+            std::memcpy(&type, message, std::min<size_t>(sizeof(type), received));
+
+            if (static_cast<size_t>(received) < sizeof(type) || type.version != service::kVersion) {
+                std::cerr << "warning: client speaks another protocol version.\n";
+                if (passed >= 0)
+                    close(passed);
+                disconnect(connection);
+                continue;
+            }
+
+            switch (type.type) {
+                case service::MessageType::Attach: {
+                    service::AttachMessage attach;
+                    if (received == sizeof(attach)) {
+                        std::memcpy(&attach, message, sizeof(attach));
+                        handle_attach(connection, attach, passed);
+                        passed = -1;
+                    }
+                    break;
+                }
+
+                case service::MessageType::Detach: {
+                    service::DetachMessage detach;
+                    if (received != sizeof(detach))
+                        break;
+
+                    std::memcpy(&detach, message, sizeof(detach));
+                    if (auto it = connection.buffers.find(detach.buffer); it != connection.buffers.end()) {
+                        unmap(it->second);
+                        connection.buffers.erase(it);
+                    }
+                    break;
+                }
+
+                case service::MessageType::Frame: {
+                    service::FrameMessage frame;
+                    if (received == sizeof(frame))
+                        std::memcpy(&frame, message, sizeof(frame));
+
+                    if (received != sizeof(frame) || !valid_frame(connection, frame)) {
+                        send_result(connection, service::Status::BadRequest, frame.id);
+                        break;
+                    }
+
+                    const auto& mapping = connection.buffers[frame.buffer];
+                    cv::Mat view(frame.height, frame.width, CV_8UC3,
+                                 const_cast<unsigned char*>(mapping.data + frame.offset), frame.stride);
+
+                    auto captured = (frame.captured_ns > 0)
+                        ? clock::time_point(std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds(frame.captured_ns)))
+                        : clock::now();
+
+                    auto tag = next_tag++;
+                    pending[tag] = {static_cast<int>(i), connection.generation, frame.id};
+
+                    // copied here, so the client may reuse the buffer as
+                    // soon as any result for this frame has arrived.
+                    server.submit(static_cast<int>(i), view, captured, tag);
+                    break;
+                }
+
+                default:
+                    std::cerr << "warning: unknown message type " << static_cast<uint32_t>(type.type) << ".\n";
+                    break;
+            }
+
+            if (passed >= 0)
+                close(passed);
+        }
+    }
+
+    server.stop();
+
+    for (auto& connection : connections) {
+        if (connection.fd >= 0)
+            disconnect(connection);
+    }
+
+    close(listener);
+    close(wakeup);
+    unlink(options.socket.c_str());
+
+    budget.untrack("engine");
+
+    for (size_t i = 0; i < connections.size(); ++i) {
+        auto stats = server.stats(static_cast<int>(i));
+        if (stats.submitted == 0)
+            continue;
+
+        std::cout << "stream " << i << ": " << stats.submitted << " submitted, " << stats.inferred << " inferred, "
+                  << stats.replaced << " replaced, " << stats.expired << " expired\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,316 @@
+#include "handtrack.h"
+
+#include "Defs.h"
+#include "EngineProvider.h"
+#include "ModelRunner.h"
+#include "ResultPublisher.h"
+#include "ResultWriter.h"
+#include "ThreadBudget.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace handtrack {
+
+namespace {
+
+ModelVariant to_variant(Models models) {
+    switch (models) {
+        case Models::Lite: return ModelVariant::Lite;
+        case Models::Full: return ModelVariant::Full;
+        default: return ModelVariant::Adaptive;
+    }
+}
+
+EngineConfig to_engine(const Config& config) {
+    return EngineConfig(config.backend == Backend::TFLite ? Kind::TFLite : Kind::Optimium,
+                        to_variant(config.models),
+                        config.threads);
+}
+
+int64_t to_ns(FrameStamp::clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+} // namespace
+
+struct Pipeline::Impl {
+    ThreadPlan plan = ThreadBudget().plan(1);
+
+    // the runner's worker uses the engines and the publisher, so it is
+    // declared last and stopped first.
+    EngineProvider own_engines;
+    EngineProvider& engines;
+    std::unique_ptr<ResultPublisher> publisher;
+    std::unique_ptr<ResultWriter> writer;
+    ModelRunner runner;
+
+    Config active;
+    Config requested;
+    std::string ring;
+    std::string log;
+    std::shared_ptr<InferEngine> engine;
+    bool rejected = false;
+
+    // the engine switched away from, held until the worker is off it
+    std::shared_ptr<InferEngine> leaving;
+    EngineConfig left;
+
+    // push() side
+    cv::Mat converted;
+    int64_t next_sequence = 0;
+    int64_t pushed = 0;
+
+    // written by the worker, read by poll()
+    std::mutex result_lock;
+    Result latest;
+    int64_t results = 0;
+    int64_t polled = 0;
+
+    explicit Impl(EngineProvider* shared)
+        : engines(shared != nullptr ? *shared : own_engines) {}
+
+    ~Impl() noexcept {
+        runner.stop();
+
+        // shared engines are used by others that detect on every frame
+        if (engine != nullptr)
+            engine->set_detection_interval(1);
+    }
+
+    Config resolve(Config config) const {
+        if (config.threads <= 0)
+            config.threads = plan.engine_threads;
+        config.detection_interval = std::max(1, config.detection_interval);
+        config.result_ring = active.result_ring;
+        config.result_log = active.result_log;
+        return config;
+    }
+
+    static bool same_engine(const Config& a, const Config& b) {
+        return a.backend == b.backend && a.models == b.models && a.threads == b.threads;
+    }
+
+    void store(const ResultStamp& stamp, bool detected, const std::vector<cv::Rect>& boxes, const InferEngine& engine) {
+        const auto& landmarks = engine.precise_landmarks();
+
+        if (publisher)
+            publisher->publish(stamp, detected, boxes, landmarks);
+        if (writer)
+            writer->append(stamp, detected, boxes, engine);
+
+        std::unique_lock lock(result_lock);
+        latest.frame = stamp.frame.sequence;
+        latest.captured_ns = to_ns(stamp.frame.captured);
+        latest.preprocessed_ns = to_ns(stamp.preprocessed);
+        latest.inferred_ns = to_ns(stamp.inferred);
+        latest.detected = detected;
+
+        latest.box_count = std::min<int>(boxes.size(), kMaxBoxes);
+        for (auto i = 0; i < latest.box_count; ++i)
+            latest.boxes[i] = { boxes[i].x, boxes[i].y, boxes[i].width, boxes[i].height };
+
+        if (detected) {
+            auto count = std::min<int>(landmarks.size(), kLandmarks);
+            for (auto i = 0; i < count; ++i)
+                latest.landmarks[i] = { landmarks[i].x, landmarks[i].y };
+        }
+
+        results += 1;
+    }
+
+    // switch engines without blocking: keep the current one until the
+    // requested one has finished loading. one switch at a time.
+    void switch_if_ready() {
+        if (leaving && !runner.switching())
+            release();
+
+        if (same_engine(requested, active) || leaving)
+            return;
+
+        auto config = to_engine(requested);
+        if (engines.try_get(config) != nullptr) {
+            auto next = engines.share(config);
+            next->set_detection_interval(requested.detection_interval);
+            runner.set_engine(*next);
+            engine->set_detection_interval(1);
+
+            leaving = std::exchange(engine, std::move(next));
+            left = to_engine(active);
+            active = requested;
+        } else if (engines.failed(config)) {
+            rejected = true;
+            requested = active;
+        }
+    }
+
+    // the engine left on the same backend is freed, unless others still
+    // share it. another backend stays loaded, to switch back to.
+    void release() {
+        leaving.reset();
+        if (left.kind == to_engine(active).kind)
+            engines.evict(left);
+    }
+};
+
+Pipeline::Pipeline(std::unique_ptr<Impl> impl)
+    : m_impl(std::move(impl)) {}
+
+Pipeline::~Pipeline() noexcept = default;
+
+// static
+std::unique_ptr<Pipeline> Pipeline::create(const Config& config) {
+    return create(config, nullptr);
+}
+
+// static
+std::unique_ptr<Pipeline> Pipeline::create(const Config& config, EngineProvider& engines) {
+    return create(config, &engines);
+}
+
+// static
+std::unique_ptr<Pipeline> Pipeline::create(const Config& config, EngineProvider* engines) {
+    auto impl = std::make_unique<Impl>(engines);
+
+    if (config.result_ring != nullptr) {
+        impl->ring = config.result_ring;
+        impl->active.result_ring = impl->ring.c_str();
+
+        impl->publisher = std::make_unique<ResultPublisher>(impl->ring);
+        if (impl->publisher->open())
+            return nullptr;
+    }
+
+    if (config.result_log != nullptr) {
+        impl->log = config.result_log;
+        impl->active.result_log = impl->log.c_str();
+
+        ResultWriterOptions options;
+        options.format = ResultWriter::format_of(impl->log);
+
+        impl->writer = std::make_unique<ResultWriter>(impl->log, options);
+        if (impl->writer->open())
+            return nullptr;
+    }
+
+    impl->active = impl->resolve(config);
+    impl->requested = impl->active;
+
+    impl->engine = impl->engines.share(to_engine(impl->active));
+    if (impl->engine == nullptr)
+        return nullptr;
+    impl->engine->set_detection_interval(impl->active.detection_interval);
+
+    auto* self = impl.get();
+    impl->runner.set_engine(*impl->engine);
+    impl->runner.set_motion_gate(impl->active.motion_threshold, impl->active.motion_max_skip);
+    impl->runner.set_spin(impl->plan.spin);
+    impl->runner.set_listener([self](const ResultStamp& stamp, bool detected, const std::vector<cv::Rect>& boxes,
+                                     const InferEngine& engine) {
+        self->store(stamp, detected, boxes, engine);
+    });
+
+    if (impl->runner.start())
+        return nullptr;
+
+    return std::unique_ptr<Pipeline>(new Pipeline(std::move(impl)));
+}
+
+bool Pipeline::push(const Frame& frame) {
+    auto& impl = *m_impl;
+
+    int type, bytes, conversion = -1;
+    switch (frame.format) {
+        case PixelFormat::BGR24: type = CV_8UC3; bytes = 3; break;
+        case PixelFormat::RGB24: type = CV_8UC3; bytes = 3; conversion = cv::COLOR_RGB2BGR; break;
+        case PixelFormat::BGRA32: type = CV_8UC4; bytes = 4; conversion = cv::COLOR_BGRA2BGR; break;
+        default: return false;
+    }
+
+    if (frame.data == nullptr || frame.width != kWidth || frame.height != kHeight || frame.stride < frame.width * bytes)
+        return false;
+
+    // a header on the caller's pixels; nothing is allocated
+    cv::Mat view(frame.height, frame.width, type, const_cast<void*>(frame.data), frame.stride);
+    if (conversion >= 0) {
+        cv::cvtColor(view, impl.converted, conversion);
+        view = impl.converted;
+    }
+
+    impl.switch_if_ready();
+
+    FrameStamp stamp;
+    stamp.sequence = (frame.sequence >= 0) ? frame.sequence : impl.next_sequence;
+    stamp.captured = (frame.captured_ns > 0)
+        ? FrameStamp::clock::time_point(std::chrono::duration_cast<FrameStamp::clock::duration>(std::chrono::nanoseconds(frame.captured_ns)))
+        : FrameStamp::clock::now();
+
+    impl.next_sequence += 1;
+    impl.pushed += 1;
+
+    if (impl.runner.needs_infer(view))
+        impl.runner.submit(view, stamp);
+
+    return true;
+}
+
+bool Pipeline::poll(Result& out) {
+    auto& impl = *m_impl;
+
+    std::unique_lock lock(impl.result_lock);
+    if (impl.results == impl.polled)
+        return false;
+
+    out = impl.latest;
+    impl.polled = impl.results;
+    return true;
+}
+
+void Pipeline::prepare(const Config& config) {
+    m_impl->engines.prewarm(to_engine(m_impl->resolve(config)));
+}
+
+void Pipeline::configure(const Config& config) {
+    auto& impl = *m_impl;
+    auto resolved = impl.resolve(config);
+
+    impl.engine->set_detection_interval(resolved.detection_interval);
+    if (resolved.motion_threshold != impl.active.motion_threshold ||
+        resolved.motion_max_skip != impl.active.motion_max_skip)
+        impl.runner.set_motion_gate(resolved.motion_threshold, resolved.motion_max_skip);
+
+    impl.requested = resolved;
+
+    if (Impl::same_engine(resolved, impl.active))
+        impl.active = resolved;
+    else
+        impl.engines.prewarm(to_engine(resolved));
+}
+
+bool Pipeline::rejected() {
+    return std::exchange(m_impl->rejected, false);
+}
+
+const Config& Pipeline::config() const {
+    return m_impl->active;
+}
+
+Stats Pipeline::stats() const {
+    auto& impl = *m_impl;
+
+    Stats stats;
+    stats.pushed = impl.pushed;
+    stats.skipped = impl.runner.skipped();
+    stats.replaced = impl.runner.replaced();
+    stats.latency_ms = impl.runner.average();
+    return stats;
+}
+
+} // namespace handtrack
@@ -0,0 +1,150 @@
+#pragma once
+
+// Embeddable hand tracking.
+//
+//   auto pipeline = handtrack::Pipeline::create({});
+//
+//   handtrack::Frame frame{ pixels, 640, 480, 640 * 3, handtrack::PixelFormat::BGR24 };
+//   pipeline->push(frame);
+//
+//   handtrack::Result result;
+//   if (pipeline->poll(result) && result.detected)
+//       use(result.landmarks);
+//
+// Inference runs on a worker thread owned by the pipeline. push() and
+// poll() never block on it and never allocate: frames are copied into
+// buffers sized on the first push, and results are copied into the
+// caller's Result. poll() may run on any thread; everything else must
+// come from one thread at a time.
+//
+// This header does not depend on OpenCV or the engines.
+
+#include <cstdint>
+#include <memory>
+
+class EngineProvider;
+
+namespace handtrack {
+
+constexpr int kLandmarks = 21;
+constexpr int kMaxBoxes = 4;
+
+enum class Backend {
+    TFLite,    // XNNPACK delegate
+    Optimium,
+};
+
+enum class Models {
+    Lite,
+    Full,      // needs palm_detection_full and hand_landmark_full
+    Adaptive,  // loads both and picks per frame within the frame time
+};
+
+enum class PixelFormat {
+    BGR24,
+    RGB24,
+    BGRA32,
+};
+
+struct Config {
+    Backend backend = Backend::TFLite;
+    Models models = Models::Lite;
+    int threads = 0;              // per model, 0 sizes them from the cores
+    int detection_interval = 1;   // run the palm detector on every n-th inferred frame
+    float motion_threshold = 0.0f; // skip frames that barely changed, 0 infers every frame
+    int motion_max_skip = 15;     // infer at least every n-th frame anyway
+    const char* result_ring = nullptr; // also publish to this shared memory ring, see ResultRing.h
+    const char* result_log = nullptr;  // also write to this file, binary if it ends in .bin, see ResultWriter.h
+};
+
+// caller owned pixels, only read during push().
+struct Frame {
+    const void* data = nullptr;
+    int width = 0;   // 640x480 only, as the models' crop geometry assumes
+    int height = 0;
+    int stride = 0;  // bytes per row
+    PixelFormat format = PixelFormat::BGR24;
+    int64_t sequence = -1;    // echoed in the result, -1 numbers frames in push order
+    int64_t captured_ns = 0;  // steady_clock, 0 for when it is pushed
+};
+
+struct Point {
+    float x;
+    float y;
+};
+
+struct Box {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+struct Result {
+    int64_t frame = -1;       // sequence of the frame it was computed on
+    int64_t captured_ns = 0;  // steady_clock
+    int64_t preprocessed_ns = 0;
+    int64_t inferred_ns = 0;
+    bool detected = false;    // landmarks are valid
+    int box_count = 0;
+    Box boxes[kMaxBoxes];
+    Point landmarks[kLandmarks];
+};
+
+struct Stats {
+    int64_t pushed = 0;
+    int64_t skipped = 0;   // static frames not inferred
+    int64_t replaced = 0;  // pushed while the worker was busy and replaced by a newer one
+    float latency_ms = 0.0f; // mean of the last inferences
+};
+
+class Pipeline final {
+public:
+    // loads the models and starts the worker. nullptr on failure.
+    static std::unique_ptr<Pipeline> create(const Config& config);
+
+    // same, with engines from a provider the host shares with other users
+    // of the engines. it must outlive the pipeline.
+    static std::unique_ptr<Pipeline> create(const Config& config, EngineProvider& engines);
+
+    ~Pipeline() noexcept;
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // hand over a frame. false if its size or layout is not supported.
+    bool push(const Frame& frame);
+
+    // copy the newest result into out. false if there is none newer than
+    // the last one polled.
+    bool poll(Result& out);
+
+    // load the engine of config in the background so a later configure()
+    // to it switches at once.
+    void prepare(const Config& config);
+
+    // switch to config. detection interval and motion gate apply at once;
+    // another backend, model or thread count switches on a later push()
+    // once its engine has loaded, without stalling the caller. the engine
+    // left on the same backend is then evicted from the provider.
+    void configure(const Config& config);
+
+    // true once if the engine of the last configure() failed to load. the
+    // pipeline stays on the previous one.
+    bool rejected();
+
+    // configuration currently running, with threads resolved.
+    const Config& config() const;
+
+    Stats stats() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+
+    explicit Pipeline(std::unique_ptr<Impl> impl);
+
+    static std::unique_ptr<Pipeline> create(const Config& config, EngineProvider* engines);
+};
+
+} // namespace handtrack
@@ -2,38 +2,48 @@
 #include "Defs.h"
 #include "Recorder.h"
 #include "ModelRunner.h"
+#include "StreamServer.h"
+#include "EngineProvider.h"
+#include "Affinity.h"
+#include "FrameAges.h"
+#include "CaptureThread.h"
+#include "FramePacer.h"
+#include "ThreadBudget.h"
+#include "Governor.h"
+#include "ResultWriter.h"
+#include "FrameFile.h"
+#include "TensorCapture.h"
+#include "handtrack.h"
 
 #include <opencv2/core.hpp>
 #include <opencv2/videoio.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <cstdarg>
 #include <ctime>
+#include <future>
 #include <chrono>
 #include <thread>
 #include <iostream>
+#include <limits>
+#include <sstream>
+#include <atomic>
+#include <mutex>
 
 #include <dirent.h>
 #include <sys/stat.h>
 
-using timer = std::chrono::high_resolution_clock;
-
 using ms = std::chrono::milliseconds;
 
-inline ms to_ms(timer::duration d) {
-    return std::chrono::duration_cast<ms>(d);
-}
-
-enum class Kind {
-    TFLite,
-    Optimium
-};
-
 const auto help_message = R"(
 Optimium Demo App Command:
   - 'l' : Live demo mode
   - 'd' : Diffrentiate mode
+  - 'm' : Multi-stream mode
+  - 'a' : Live A/B mode
   - 'r' : Show previous record
   - 'q' : Quit the app
 
@@ -79,13 +89,15 @@ const static auto kTextColor = CV_RGB(255, 0, 190);
 const static auto kVertexColor = CV_RGB(0, 100, 255);
 const static auto kEdgeColor = CV_RGB(0, 255, 30);
 
-std::unique_ptr<InferEngine> tflite;
-std::unique_ptr<InferEngine> optimium;
+EngineProvider engines;
+ThreadBudget budget;
 
 int initialize();
 void finalize();
 int run_live_demo();
 int run_diff_demo();
+int run_multi_demo();
+int run_ab_demo();
 
 // save camera configurations
 double zoom = 130;
@@ -105,6 +117,43 @@ std::string format(const char* format, ...) {
     return std::string(buffer, len);
 }
 
+// camera index, v4l2 device (e.g. v4l2loopback), raw frame file or video
+// file. nullptr if it cannot be opened.
+static std::unique_ptr<cv::VideoCapture> open_source(const std::string& source) {
+    std::unique_ptr<cv::VideoCapture> reader;
+    bool opened;
+
+    if (FrameFileWriter::is_frame_file(source)) {
+        reader = std::make_unique<FrameFileCapture>();
+        opened = reader->open(source);
+    } else {
+        reader = std::make_unique<cv::VideoCapture>();
+
+        if (!source.empty() && std::all_of(source.begin(), source.end(), ::isdigit))
+            opened = reader->open(std::stoi(source), cv::CAP_V4L2);
+        else if (source.rfind("/dev/video", 0) == 0)
+            opened = reader->open(source, cv::CAP_V4L2);
+        else
+            opened = reader->open(source, cv::CAP_FFMPEG);
+    }
+
+    if (!opened)
+        return nullptr;
+
+    return reader;
+}
+
+// recording of timestamp, raw if it was recorded raw.
+static std::string recording_name(const std::string& timestamp) {
+    auto raw = format("outputs/record_data_%s.frames", timestamp.c_str());
+
+    struct stat info;
+    if (stat(raw.c_str(), &info) == 0)
+        return raw;
+
+    return format("outputs/record_data_%s.avi", timestamp.c_str());
+}
+
 std::string find_latest_record() {
     auto* dir = opendir("outputs");
 
@@ -184,6 +233,16 @@ int main() {
                     run = false;
                 break;
 
+            case 'm':
+                if (run_multi_demo())
+                    run = false;
+                break;
+
+            case 'a':
+                if (run_ab_demo())
+                    run = false;
+                break;
+
             case 'r': {
                 auto video = find_latest_record();
 
@@ -214,21 +273,20 @@ int initialize() {
         return 1;
     }
 
-    // Loading tflite
-    tflite = InferEngine::create_tflite_engine();
-    if (!tflite)
-        return 1;
+    // one engine infers at a time outside of the multi-stream and A/B modes.
+    auto plan = budget.plan(1);
+    budget.apply(plan);
+    engines.set_threads(plan.engine_threads);
 
-    optimium = InferEngine::create_optimium_engine();
-    if (!optimium)
-        return 1;
+    // engines are created on first use. start the default one now; both
+    // load concurrently if the other one is requested meanwhile.
+    engines.prewarm(Kind::TFLite);
 
     return 0;
 }
 
 void finalize() {
-    tflite.reset();
-    optimium.reset();
+    engines.reset();
 }
 
 static void config_reader(cv::VideoCapture& capture) {
@@ -265,6 +323,83 @@ static void render_text(cv::Mat& frame, Kind kind, float latency) {
     cv::putText(frame, text_buffer, cv::Point(10, 60), cv::FONT_HERSHEY_DUPLEX, 1.0, kTextColor);
 }
 
+static void render_ages(cv::Mat& frame, const FrameAges& ages) {
+    char text_buffer[128];
+
+    snprintf(text_buffer, sizeof(text_buffer), "capture to result: p50 %.0fms / p99 %.0fms",
+             ages.display.percentile(50), ages.display.percentile(99));
+    cv::putText(frame, text_buffer, cv::Point(10, 90), cv::FONT_HERSHEY_DUPLEX, 0.7, kTextColor);
+
+    snprintf(text_buffer, sizeof(text_buffer), "reused: %lld of %lld frames",
+             static_cast<long long>(ages.reused()), static_cast<long long>(ages.displayed()));
+    cv::putText(frame, text_buffer, cv::Point(10, 115), cv::FONT_HERSHEY_DUPLEX, 0.7, kTextColor);
+}
+
+static void render_pacing(cv::Mat& frame, const FramePacer::Stats& stats) {
+    char text_buffer[128];
+
+    snprintf(text_buffer, sizeof(text_buffer), "display: %.1f FPS / missed %lld",
+             stats.fps, static_cast<long long>(stats.missed));
+    cv::putText(frame, text_buffer, cv::Point(10, 140), cv::FONT_HERSHEY_DUPLEX, 0.7, kTextColor);
+}
+
+static void render_quality(cv::Mat& frame, const char* point, const Governor::Readings& readings, bool governed) {
+    char text_buffer[128];
+
+    snprintf(text_buffer, sizeof(text_buffer), "quality: %s%s / %.0fC", point, governed ? "" : " (fixed)",
+             readings.celsius);
+    cv::putText(frame, text_buffer, cv::Point(10, 165), cv::FONT_HERSHEY_DUPLEX, 0.7, kTextColor);
+}
+
+static handtrack::Models to_models(ModelVariant variant) {
+    switch (variant) {
+        case ModelVariant::Lite: return handtrack::Models::Lite;
+        case ModelVariant::Full: return handtrack::Models::Full;
+        default: return handtrack::Models::Adaptive;
+    }
+}
+
+static Kind to_kind(handtrack::Backend backend) {
+    return (backend == handtrack::Backend::TFLite) ? Kind::TFLite : Kind::Optimium;
+}
+
+static int64_t to_ns(FrameStamp::clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static ResultStamp to_result_stamp(const handtrack::Result& result) {
+    auto to_time = [](int64_t ns) {
+        return FrameStamp::clock::time_point(
+            std::chrono::duration_cast<FrameStamp::clock::duration>(std::chrono::nanoseconds(ns)));
+    };
+
+    ResultStamp stamp;
+    stamp.frame.sequence = result.frame;
+    stamp.frame.captured = to_time(result.captured_ns);
+    stamp.preprocessed = to_time(result.preprocessed_ns);
+    stamp.inferred = to_time(result.inferred_ns);
+    return stamp;
+}
+
+static void print_pacing(const FramePacer::Stats& stats) {
+    std::cout << "display: " << stats.fps << " FPS, " << stats.presented << " presented, " << stats.repeated
+              << " repeated, " << stats.dropped << " dropped, " << stats.missed << " missed deadlines\n";
+}
+
+static void print_ages(const FrameAges& ages) {
+    auto print = [](const char* name, const LatencyWindow& window) {
+        std::cout << "  - " << name << ": p50 " << window.percentile(50) << "ms / p99 "
+                  << window.percentile(99) << "ms\n";
+    };
+
+    std::cout << "age since capture:\n";
+    print("preprocessed", ages.preprocess);
+    print("inferred", ages.infer);
+    print("result displayed", ages.display);
+    print("frame displayed", ages.frame);
+    std::cout << "  - reused results: " << ages.reused() << " of " << ages.displayed() << " displayed frames\n";
+}
+
 
 int run_live_demo() {
     cv::VideoCapture reader(0);
@@ -275,80 +410,171 @@ int run_live_demo() {
 
     config_reader(reader);
 
-    ModelRunner runner;
-    Kind kind = Kind::TFLite;
+    CaptureThread capture(reader);
+    FramePacer pacer("Demo");
 
     cv::Mat current, prev;
+    FrameStamp current_stamp, prev_stamp;
+    FrameAges ages;
+
+    // start at lite models on every frame, which are always there, and
+    // let the governor move from there as latency and temperature allow.
+    auto plan = budget.plan(1);
+    Governor governor(Governor::default_points(plan.engine_threads), 2);
+    bool governed = true;
 
     // set default engine: tflite
-    runner.set_engine(*tflite);
-    runner.start();
+    handtrack::Config config;
+    config.backend = handtrack::Backend::TFLite;
+    config.models = to_models(governor.current().variant);
+    config.threads = governor.current().threads;
+    config.detection_interval = governor.current().detect_interval;
+    config.motion_threshold = kMotionThreshold;
+    config.motion_max_skip = kMotionMaxSkip;
+
+    // live results go to local consumers too if a ring name is given.
+    if (const char* ring = getenv(kResultRingEnv); ring != nullptr && *ring != '\0') {
+        config.result_ring = ring;
+        std::cerr << "publishing results to " << ring << "\n";
+    }
+
+    // and to a file for later analysis.
+    if (const char* log = getenv(kResultLogEnv); log != nullptr && *log != '\0') {
+        config.result_log = log;
+        std::cerr << "writing results to " << log << "\n";
+    }
+
+    auto tracker = handtrack::Pipeline::create(config, engines);
+    if (!tracker)
+        return 1;
+
+    // the other engine is only needed once the user switches.
+    auto other = config;
+    other.backend = handtrack::Backend::Optimium;
+    tracker->prepare(other);
+
+    int tracked = tracker->config().threads;
+    budget.track("engine", tracked);
+    budget.report();
+
+    // the pipeline loads the point's engine in the background and switches
+    // once it is ready; the other knobs take effect at once.
+    auto apply_point = [&](const OperatingPoint& point) {
+        config.models = to_models(point.variant);
+        config.threads = point.threads;
+        config.detection_interval = point.detect_interval;
+        tracker->configure(config);
+
+        capture.set(cv::CAP_PROP_FPS, point.fps);
+        pacer.set_fps(point.fps);
+    };
+
+    if (capture.start())
+        return 1;
 
-    auto time_point = timer::now();
+    pacer.start();
+
+    handtrack::Result latest;
+    std::vector<cv::Point> landmarks;
     bool run = true;
 
     while (run) {
-        if (!reader.read(current)) {
-            std::cerr << "error: camera read error.\n";
-            return 1;
+        // newest frame; older ones are dropped if we fell behind.
+        if (!capture.wait(current, current_stamp, ms(kCaptureTimeoutMS))) {
+            if (capture.failed())
+                return 1;
+            continue;
+        }
+
+        if (tracker->rejected()) {
+            const auto& running = tracker->config();
+            bool by_governor = config.models != running.models || config.threads != running.threads;
+            config = running;
+
+            // e.g. the full models are not installed
+            if (by_governor) {
+                governor.disable(governor.index());
+                apply_point(governor.current());
+            }
+        }
+
+        if (tracker->config().threads != tracked) {
+            tracked = tracker->config().threads;
+            budget.track("engine", tracked);
         }
-        
-        // transform data
-        runner.update_data(current);
 
-        // start inference if model is not running.
-        if (!runner.is_running())
-            runner.infer();
+        if (tracker->poll(latest)) {
+            governor.add_latency((latest.inferred_ns - latest.captured_ns) / 1e6f);
 
-        auto now = timer::now();
-        auto delay = 33 - to_ms(now - time_point).count();
+            landmarks.clear();
+            if (latest.detected) {
+                for (const auto& landmark : latest.landmarks)
+                    landmarks.emplace_back(static_cast<int>(landmark.x), static_cast<int>(landmark.y));
+            }
+        }
 
-        if (delay > 0)
-            std::this_thread::sleep_for(ms(delay));
+        if (governed && governor.update())
+            apply_point(governor.current());
+
+        // hand over every frame; the pipeline skips the static ones and,
+        // if the model is still busy, picks up the newest when it is done.
+        tracker->push({ current.data, current.cols, current.rows, static_cast<int>(current.step),
+                        handtrack::PixelFormat::BGR24, current_stamp.sequence, to_ns(current_stamp.captured) });
 
         if (prev.empty()) {
             std::swap(current, prev);
+            std::swap(current_stamp, prev_stamp);
             continue;
         }
 
-        if (runner.detected)
-            render_landmarks(prev, runner.landmarks());
-        render_text(prev, kind, runner.average());
-
-        cv::imshow("Demo", prev);
+        // drawn on the display thread; ages is only touched there until
+        // the pacer stops.
+        pacer.submit(prev, [&ages, &pacer, landmarks, kind = to_kind(tracker->config().backend),
+                            latency = tracker->stats().latency_ms, shown = prev_stamp, result = to_result_stamp(latest),
+                            point = governor.current().name, readings = governor.readings(), governed](cv::Mat& frame) {
+            if (!landmarks.empty())
+                render_landmarks(frame, landmarks);
+            render_text(frame, kind, latency);
+            render_ages(frame, ages);
+            render_pacing(frame, pacer.stats());
+            render_quality(frame, point, readings, governed);
+            ages.displayed(shown, result, FrameStamp::clock::now());
+        });
 
         std::swap(current, prev);
+        std::swap(current_stamp, prev_stamp);
 
-        auto key = cv::waitKey(1);
+        auto key = pacer.key();
         switch (key) {
             default:
                 // do nothing
                 break;
 
             case 's': {
-                // switch model
-                kind = (kind == Kind::TFLite) ? Kind::Optimium : Kind::TFLite;
+                // switch model. takes effect once the engine is ready.
+                config.backend = (config.backend == handtrack::Backend::TFLite) ? handtrack::Backend::Optimium
+                                                                                : handtrack::Backend::TFLite;
+                tracker->configure(config);
+                break;
+            }
 
-                if (kind == Kind::TFLite) {
-                    runner.set_engine(*tflite);
-                } else {
-                    runner.set_engine(*optimium);
-                }
+            case 'g': {
+                // hold the current operating point, or hand it back to the governor.
+                governed = !governed;
+                std::cerr << "governor: " << (governed ? "on" : "off") << "\n";
                 break;
             }
 
             case '+': case '=': {
                 zoom += 10;
-                reader.set(cv::CAP_PROP_ZOOM, zoom);
-                zoom = reader.get(cv::CAP_PROP_ZOOM);
+                zoom = capture.set(cv::CAP_PROP_ZOOM, zoom);
                 std::cerr << "zoom: " << zoom << "\n";
                 break;
             }
 
             case '-': {
                 zoom -= 10;
-                reader.set(cv::CAP_PROP_ZOOM, zoom);
-                zoom = reader.get(cv::CAP_PROP_ZOOM);
+                zoom = capture.set(cv::CAP_PROP_ZOOM, zoom);
                 std::cerr << "zoom: " << zoom << "\n";
                 break;
             }
@@ -359,7 +585,18 @@ int run_live_demo() {
         }
     }
 
-    cv::destroyAllWindows();
+    capture.stop();
+    pacer.stop();
+
+    auto inferred = tracker->stats();
+    tracker.reset();
+    budget.untrack("engine");
+    print_ages(ages);
+    print_pacing(pacer.stats());
+
+    auto stats = capture.stats();
+    std::cout << "captured " << stats.captured << " frames, " << stats.dropped << " dropped before use, "
+              << inferred.skipped << " skipped as static, " << inferred.replaced << " replaced before inference.\n";
 
     return 0;
 }
@@ -367,7 +604,10 @@ int run_live_demo() {
 
 static int record(const std::string& timestamp) {
     cv::VideoCapture reader;
-    auto file = format("outputs/record_data_%s.avi", timestamp.c_str());
+
+    // raw frames replay without decoding, at the cost of ~27MB/s of disk
+    const char* raw = getenv(kRecordRawEnv);
+    auto file = format("outputs/record_data_%s.%s", timestamp.c_str(), (raw != nullptr && *raw != '\0') ? "frames" : "avi");
     Recorder recorder(file);
 
     if (!reader.open("/dev/video0", cv::CAP_V4L2)) {
@@ -377,34 +617,34 @@ static int record(const std::string& timestamp) {
 
     config_reader(reader);
 
-    cv::Mat frame, show_frame;
+    CaptureThread capture(reader);
+    if (capture.start())
+        return 1;
+
+    FramePacer pacer("Demo");
+    pacer.start();
+
+    cv::Mat frame;
+    FrameStamp stamp;
 
-    auto time_point = timer::now();
     bool run = true;
     bool recording = false;
 
     while (run) {
-        if (!reader.read(frame)) {
-            std::cerr << "error: camera read error.\n";
-            return 1;
+        if (!capture.wait(frame, stamp, ms(kCaptureTimeoutMS))) {
+            if (capture.failed())
+                return 1;
+            continue;
         }
 
-        frame.copyTo(show_frame);
+        pacer.submit(frame, [recording](cv::Mat& show_frame) {
+            cv::putText(show_frame, recording ? "Recording..." : "Idle...", cv::Point(10, 30), cv::FONT_HERSHEY_DUPLEX, 1.0, recording ? CV_RGB(255, 0, 0) : CV_RGB(0, 255, 0));
+        });
+
         if (recording)
             recorder.append(std::move(frame));
 
-        auto now = timer::now();
-        auto delay = 33 - to_ms(now - time_point).count();
-        time_point = now;
-
-        if (delay > 0)
-            std::this_thread::sleep_for(ms(delay));
-
-        cv::putText(show_frame, recording ? "Recording..." : "Idle...", cv::Point(10, 30), cv::FONT_HERSHEY_DUPLEX, 1.0, recording ? CV_RGB(255, 0, 0) : CV_RGB(0, 255, 0));
-
-        cv::imshow("Demo", show_frame);
-
-        auto key = cv::waitKey(1);
+        auto key = pacer.key();
         switch (key) {
             default:
                 // do nothing
@@ -424,16 +664,14 @@ static int record(const std::string& timestamp) {
 
             case '+': case '=': {
                 zoom += 10;
-                reader.set(cv::CAP_PROP_ZOOM, zoom);
-                zoom = reader.get(cv::CAP_PROP_ZOOM);
+                zoom = capture.set(cv::CAP_PROP_ZOOM, zoom);
                 std::cerr << "zoom: " << zoom << "\n";
                 break;
             }
 
             case '-': {
                 zoom -= 10;
-                reader.set(cv::CAP_PROP_ZOOM, zoom);
-                zoom = reader.get(cv::CAP_PROP_ZOOM);
+                zoom = capture.set(cv::CAP_PROP_ZOOM, zoom);
                 std::cerr << "zoom: " << zoom << "\n";
                 break;
             }
@@ -444,16 +682,21 @@ static int record(const std::string& timestamp) {
         }
     }
 
-    cv::destroyAllWindows();
+    capture.stop();
+    pacer.stop();
+
+    auto stats = capture.stats();
+    if (stats.dropped > 0)
+        std::cerr << "warning: " << stats.dropped << " of " << stats.captured << " frames were not recorded.\n";
 
     return 0;
 }
 
 static int record_model(InferEngine& engine, Kind kind, const std::string& timestamp) {
-    cv::VideoCapture reader;
-    auto input_name = format("outputs/record_data_%s.avi", timestamp.c_str());
+    auto input_name = recording_name(timestamp);
 
-    if (!reader.open(input_name, cv::CAP_FFMPEG)) {
+    auto reader = open_source(input_name);
+    if (!reader) {
         std::cerr << "error: failed to open " << input_name << ".\n";
         return 1;
     }
@@ -463,37 +706,52 @@ static int record_model(InferEngine& engine, Kind kind, const std::string& times
     Recorder recorder(output_name);
     recorder.start();
 
-    config_reader(reader);
+    // what was detected, next to the rendered video
+    auto results_name = format("outputs/record_%s_%s.jsonl", (kind == Kind::TFLite) ? "tflite" : "optimium", timestamp.c_str());
+
+    ResultWriter results(results_name);
+    if (results.open())
+        return 1;
+
+    // raw tensors for rpi-replay, if asked for
+    auto capture_name = format("outputs/record_%s_%s.capture", (kind == Kind::TFLite) ? "tflite" : "optimium", timestamp.c_str());
+    TensorCapture capture(capture_name);
+
+    if (const char* enabled = getenv(kTensorCaptureEnv); enabled != nullptr && *enabled != '\0') {
+        if (capture.open())
+            return 1;
+        engine.set_capture(&capture);
+        std::cerr << "capturing tensors to " << capture_name << "\n";
+    }
 
     ModelRunner runner;
 
     cv::Mat current, prev;
+    FrameStamp stamp;
 
     runner.set_engine(engine);
+    runner.set_spin(budget.plan(1).spin);
+    runner.set_listener([&results](const ResultStamp& result, bool detected, const std::vector<cv::Rect>& boxes,
+                                   const InferEngine& engine) { results.append(result, detected, boxes, engine); });
     runner.start();
 
-    auto time_point = timer::now();
+    // replay at camera rate so the runner skips frames like it does live.
+    PaceClock pace(kFPS);
     bool run = true;
 
     while (run) {
-        if (!reader.read(current)) {
+        if (!reader->read(current)) {
             // done
             break;
         }
 
-        // transform data
-        runner.update_data(current);
-
-        // start inference if model is not running.
-        if (!runner.is_running())
-            runner.infer();
-
-        auto now = timer::now();
-        auto delay = 33 - to_ms(now - time_point).count();
-        time_point = now;
+        // inferred once the model is done with the previous frame, unless
+        // a newer one replaces it first.
+        stamp.sequence += 1;
+        stamp.captured = FrameStamp::clock::now();
+        runner.submit(current, stamp);
 
-        if (delay > 0)
-            std::this_thread::sleep_for(ms(delay));
+        pace.wait();
 
         if (prev.empty()) {
             std::swap(current, prev);
@@ -509,6 +767,9 @@ static int record_model(InferEngine& engine, Kind kind, const std::string& times
         std::swap(current, prev);
     }
 
+    runner.stop();
+    engine.set_capture(nullptr);
+
     return 0;
 }
 
@@ -568,31 +829,31 @@ static int show(const std::string& file_name) {
     }
 
     cv::Mat frame;
-    auto time_point = timer::now();
     int delta = 100;
     bool pause = false;
     bool run = true;
 
-    while (run) {
-        if (!pause)
-            video >> frame;
+    // the file is read at the display rate; a paused frame stays on screen.
+    PaceClock pace(1000.0f / delta);
+    FramePacer pacer("Demo", 1000.0f / delta);
+    pacer.start();
 
-        if (frame.empty()) {
-            // rewind frame
-            video.set(cv::CAP_PROP_POS_FRAMES, 0);
-            continue;
-        }
+    while (run) {
+        pace.wait();
 
-        auto now = timer::now();
-        auto delay = delta - to_ms(now - time_point).count();
-        time_point = now;
+        if (!pause) {
+            video >> frame;
 
-        if (delay > 0)
-            std::this_thread::sleep_for(ms(delay));
+            if (frame.empty()) {
+                // rewind frame
+                video.set(cv::CAP_PROP_POS_FRAMES, 0);
+                continue;
+            }
 
-        cv::imshow("Demo", frame);
+            pacer.submit(frame);
+        }
 
-        auto key = cv::waitKey(1);
+        auto key = pacer.key();
         switch (key) {
             default:
                 // ignore
@@ -609,16 +870,20 @@ static int show(const std::string& file_name) {
             case ',':
                 delta = std::min(1000, delta + 10);
                 std::cerr << "delta: " << delta << "\n";
+                pace.set_fps(1000.0f / delta);
+                pacer.set_fps(1000.0f / delta);
                 break;
 
             case '.':
                 delta = std::max(33, delta - 10);
                 std::cerr << "delta: " << delta << "\n";
+                pace.set_fps(1000.0f / delta);
+                pacer.set_fps(1000.0f / delta);
                 break;
         }
     }
 
-    cv::destroyAllWindows();
+    pacer.stop();
 
     return 0;
 }
@@ -640,6 +905,11 @@ int run_diff_demo() {
         return ret;
 
     std::cerr << "processing data on TFLite...\n";
+    auto* tflite = engines.get(Kind::TFLite);
+    auto* optimium = engines.get(Kind::Optimium);
+    if (tflite == nullptr || optimium == nullptr)
+        return 1;
+
     if (auto ret = record_model(*tflite, Kind::TFLite, timestamp); ret)
         return ret;
 
@@ -658,3 +928,320 @@ int run_diff_demo() {
     return 0;
 }
 
+
+int run_multi_demo() {
+    std::vector<std::string> sources;
+    {
+        std::cout << "stream sources (space separated, e.g. 0 /dev/video2 clip.avi):\n";
+
+        std::string line;
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        std::getline(std::cin, line);
+
+        std::istringstream stream(line);
+        std::string source;
+        while (stream >> source && sources.size() < kMaxStreams)
+            sources.push_back(source);
+
+        if (sources.empty())
+            sources.push_back("/dev/video0");
+    }
+
+    const int count = static_cast<int>(sources.size());
+
+    std::vector<std::unique_ptr<cv::VideoCapture>> readers(count);
+    std::vector<bool> is_file(count);
+    for (auto i = 0; i < count; ++i) {
+        readers[i] = open_source(sources[i]);
+        if (!readers[i]) {
+            std::cerr << "error: failed to open " << sources[i] << ".\n";
+            return 1;
+        }
+
+        is_file[i] = readers[i]->get(cv::CAP_PROP_FRAME_COUNT) > 0;
+        if (!is_file[i])
+            config_reader(*readers[i]);
+    }
+
+    // one engine per kEngineThreads cores of the budget, never more than
+    // streams. a single engine is the shared one of the live demo.
+    auto pool_size = std::clamp<int>((budget.cores() - kReservedCores) / kEngineThreads, 1, count);
+    auto plan = budget.plan(pool_size);
+
+    std::vector<std::unique_ptr<InferEngine>> extra_engines;
+    std::vector<InferEngine*> pool;
+
+    if (pool_size == 1) {
+        auto* optimium = engines.get(Kind::Optimium);
+        if (optimium == nullptr)
+            return 1;
+        pool.push_back(optimium);
+    } else {
+        for (auto i = 0; i < pool_size; ++i) {
+            auto engine = InferEngine::create_optimium_engine(plan.engine_threads);
+            if (!engine)
+                return 1;
+
+            pool.push_back(engine.get());
+            extra_engines.push_back(std::move(engine));
+        }
+    }
+
+    budget.apply(plan);
+    budget.track("engine", pool_size * plan.engine_threads);
+    budget.report();
+
+    std::cerr << count << " streams on " << pool_size << " engines.\n";
+
+    StreamServer server(pool, count);
+    if (server.start())
+        return 1;
+
+    struct Feed {
+        std::mutex lock;
+        cv::Mat frame;
+        std::atomic<bool> alive = true;  // cleared once the source fails for good
+    };
+    std::vector<Feed> feeds(count);
+
+    std::atomic<bool> run = true;
+    std::vector<std::thread> captures;
+
+    for (auto i = 0; i < count; ++i) {
+        captures.emplace_back([&, i] {
+            cv::Mat frame;
+            PaceClock pace(kFPS);
+            bool rewound = false;
+
+            while (run) {
+                if (!readers[i]->read(frame)) {
+                    // loop files forever, unless nothing reads right after a rewind
+                    if (is_file[i] && !rewound) {
+                        readers[i]->set(cv::CAP_PROP_POS_FRAMES, 0);
+                        rewound = true;
+                        continue;
+                    }
+
+                    std::cerr << "error: " << sources[i] << " read error, dropping the stream.\n";
+                    feeds[i].alive = false;
+                    break;
+                }
+
+                rewound = false;
+
+                server.submit(i, frame, StreamServer::clock::now());
+
+                {
+                    std::unique_lock lock(feeds[i].lock);
+                    frame.copyTo(feeds[i].frame);
+                }
+
+                // files are played back at camera rate
+                if (is_file[i])
+                    pace.wait();
+            }
+        });
+    }
+
+    const int columns = static_cast<int>(std::ceil(std::sqrt(count)));
+    const int rows = (count + columns - 1) / columns;
+    const cv::Size tile = (count == 1) ? cv::Size(kWidth, kHeight) : cv::Size(kWidth / 2, kHeight / 2);
+
+    cv::Mat canvas(tile.height * rows, tile.width * columns, CV_8UC3);
+    cv::Mat frame, resized;
+    StreamServer::Result result;
+    PaceClock pace(kFPS);
+
+    while (run) {
+        canvas.setTo(cv::Scalar(0, 0, 0));
+        int alive = 0;
+
+        for (auto i = 0; i < count; ++i) {
+            cv::Rect area((i % columns) * tile.width, (i / columns) * tile.height, tile.width, tile.height);
+
+            if (!feeds[i].alive) {
+                cv::putText(canvas, format("#%d ended", i), area.tl() + cv::Point(10, 30), cv::FONT_HERSHEY_DUPLEX, 1.0, kTextColor);
+                continue;
+            }
+            ++alive;
+
+            {
+                std::unique_lock lock(feeds[i].lock);
+                feeds[i].frame.copyTo(frame);
+            }
+
+            if (frame.empty())
+                continue;
+
+            bool has_result = server.result(i, result);
+            if (has_result && result.detected)
+                render_landmarks(frame, result.landmarks);
+
+            auto stats = server.stats(i);
+            auto text = format("#%d %.02fms drop %lld", i, has_result ? result.latency : 0.0f,
+                               static_cast<long long>(stats.replaced + stats.expired));
+            cv::putText(frame, text, cv::Point(10, 30), cv::FONT_HERSHEY_DUPLEX, 1.0, kTextColor);
+
+            cv::resize(frame, resized, tile);
+            resized.copyTo(canvas(area));
+        }
+
+        if (alive == 0) {
+            std::cerr << "error: every stream ended.\n";
+            break;
+        }
+
+        cv::imshow("Demo", canvas);
+
+        pace.wait();
+
+        if (cv::waitKey(1) == 'q')
+            run = false;
+    }
+
+    for (auto& capture : captures)
+        capture.join();
+
+    server.stop();
+
+    budget.untrack("engine");
+    budget.apply(budget.plan(1));
+
+    cv::destroyAllWindows();
+
+    return 0;
+}
+
+// mean distance in pixels between corresponding landmarks.
+static float landmark_distance(const std::vector<cv::Point>& a, const std::vector<cv::Point>& b) {
+    auto count = std::min(a.size(), b.size());
+    if (count == 0)
+        return 0.0f;
+
+    float sum = 0.0f;
+    for (size_t i = 0; i < count; ++i)
+        sum += std::hypot(static_cast<float>(a[i].x - b[i].x), static_cast<float>(a[i].y - b[i].y));
+
+    return sum / count;
+}
+
+int run_ab_demo() {
+    cv::VideoCapture reader(0);
+    if (!reader.isOpened()) {
+        std::cerr << "Error: Unable to open the camera" << std::endl;
+        return -1;
+    }
+
+    config_reader(reader);
+
+    // dedicated engines so each backend owns half of the cores, sized so
+    // that both together stay within the budget.
+    auto cores = split_cores(2);
+    auto plan = budget.plan(2);
+
+    XNNPackOptions tflite_options;
+    tflite_options.threads = plan.engine_threads;
+    tflite_options.cores = cores[0];
+
+    std::cerr << "loading engines for A/B mode...\n";
+    auto tflite_future = std::async(std::launch::async, [&] {
+        return InferEngine::create_tflite_engine(tflite_options);
+    });
+    auto optimium = InferEngine::create_optimium_engine(plan.engine_threads, cores[1]);
+    auto tflite = tflite_future.get();
+
+    if (!tflite || !optimium)
+        return 1;
+
+    budget.apply(plan);
+    budget.track("engine", 2 * plan.engine_threads);
+    budget.report();
+
+    ModelRunner runners[2];
+    const Kind kinds[2] = { Kind::TFLite, Kind::Optimium };
+
+    runners[0].set_engine(*tflite);
+    runners[1].set_engine(*optimium);
+    for (auto i = 0; i < 2; ++i) {
+        runners[i].set_affinity(cores[i]);
+        runners[i].set_spin(plan.spin);
+        runners[i].start();
+    }
+
+    cv::Mat current, prev, canvas;
+    cv::Mat views[2];
+
+    bool in_flight = false;
+    int64_t compared = 0;
+    int64_t mismatched = 0; // frames where only one engine found a hand
+    float last_distance = 0.0f;
+    double distance_sum = 0.0;
+
+    PaceClock pace(kFPS);
+    bool run = true;
+
+    while (run) {
+        if (!reader.read(current)) {
+            std::cerr << "error: camera read error.\n";
+            return 1;
+        }
+
+        // both engines always work on the same frame.
+        if (!runners[0].is_running() && !runners[1].is_running()) {
+            if (in_flight) {
+                if (runners[0].detected && runners[1].detected) {
+                    last_distance = landmark_distance(runners[0].landmarks(), runners[1].landmarks());
+                    distance_sum += last_distance;
+                    compared += 1;
+                } else if (runners[0].detected != runners[1].detected) {
+                    mismatched += 1;
+                }
+            }
+
+            for (auto& runner : runners)
+                runner.submit(current);
+            in_flight = true;
+        }
+
+        pace.wait();
+
+        if (prev.empty()) {
+            std::swap(current, prev);
+            continue;
+        }
+
+        for (auto i = 0; i < 2; ++i) {
+            prev.copyTo(views[i]);
+            if (runners[i].detected)
+                render_landmarks(views[i], runners[i].landmarks());
+
+            auto text = format("p50 %.02fms / p99 %.02fms", runners[i].latency(50), runners[i].latency(99));
+            cv::putText(views[i], to_string(kinds[i]), cv::Point(10, 30), cv::FONT_HERSHEY_DUPLEX, 1.0, kTextColor);
+            cv::putText(views[i], text, cv::Point(10, 60), cv::FONT_HERSHEY_DUPLEX, 1.0, kTextColor);
+        }
+
+        cv::hconcat(views[0], views[1], canvas);
+
+        auto text = format("landmark diff: %.02fpx (mean %.02fpx) / detection mismatch: %lld",
+                           last_distance, compared ? distance_sum / compared : 0.0,
+                           static_cast<long long>(mismatched));
+        cv::putText(canvas, text, cv::Point(10, kHeight - 20), cv::FONT_HERSHEY_DUPLEX, 1.0, kTextColor);
+
+        cv::imshow("Demo", canvas);
+
+        std::swap(current, prev);
+
+        if (cv::waitKey(1) == 'q')
+            run = false;
+    }
+
+    for (auto& runner : runners)
+        runner.stop();
+
+    budget.untrack("engine");
+    budget.apply(budget.plan(1));
+
+    cv::destroyAllWindows();
+
+    return 0;
+}
@@ -0,0 +1,403 @@
+// Model level benchmark: XNNPACK vs Optimium for any .tflite / .model file.
+//
+// For every model given, the .tflite (TFLite with the XNNPACK delegate) and
+// the .model (Optimium) of the same name are both run if they exist, so
+//   rpi-model-bench --threads 2 ../../models/mediapipe_thread_2/*.model
+// benchmarks the shipped models against .tflite files placed next to them.
+// Prints the README latency table (mean in us) followed by percentiles.
+
+#include "InferEngine.h"
+#include "TFLite.h"
+#include "LatencyWindow.h"
+#include "ParseNumber.h"
+
+#include <Optimium/Runtime.h>
+#include <Optimium/Runtime/Utils/StreamHelper.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace rt = optimium::runtime;
+
+namespace {
+
+const auto usage = R"(usage: rpi-model-bench [options] <model>...
+  <model>          .tflite or .model file; its counterpart of the same name is
+                   run too if it exists
+  --threads N      inference threads (default: 1)
+  --runs N         timed invocations (default: 100)
+  --warmup N       untimed invocations before timing (default: 10)
+  --input FILE     raw bytes copied into the inputs in order, repeated to
+                   fill them (default: random data)
+  --seed N         seed of the random input (default: 0)
+)";
+
+using steady = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<std::string> models;
+    int threads = 1;
+    int runs = 100;
+    int warmup = 10;
+    std::string input;
+    unsigned seed = 0;
+};
+
+// the runtime keeps a tensor's buffer only while its BufferHolder is
+// alive. holders can be neither copied nor moved, so they are built in place.
+struct HeldBuffer {
+    rt::BufferHolder buffer;
+
+    explicit HeldBuffer(rt::Tensor& tensor) : buffer(tensor.getRawBuffer()) {}
+};
+
+// an input tensor to fill.
+struct Input {
+    void* data;
+    size_t bytes;
+    bool is_float;
+};
+
+struct Runner {
+    std::vector<Input> inputs;
+    std::function<bool()> invoke;
+
+    // keep whatever backs the tensors alive
+    std::shared_ptr<void> owner;
+};
+
+struct Measurement {
+    bool ok = false;
+    float mean = 0.0f;  // us
+    LatencyWindow window;
+};
+
+struct Row {
+    std::string name;
+    Measurement xnnpack;
+    Measurement optimium;
+};
+
+bool exists(const std::string& path) {
+    return std::ifstream(path).good();
+}
+
+std::string strip_extension(const std::string& path) {
+    auto dot = path.rfind('.');
+    auto slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path;
+    return path.substr(0, dot);
+}
+
+std::string base_name(const std::string& path) {
+    auto slash = path.rfind('/');
+    return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+bool create_tflite_runner(const std::string& path, int threads, Runner& runner) {
+    struct State {
+        std::unique_ptr<tflite::FlatBufferModel> model;
+        TfLiteDelegatePtr delegate{nullptr, TfLiteXNNPackDelegateDelete};
+        std::unique_ptr<tflite::Interpreter> interpreter;
+    };
+
+    auto state = std::make_shared<State>();
+    state->model = tflite::FlatBufferModel::BuildFromFile(path.c_str());
+    if (!state->model) {
+        std::cerr << "error: failed to load " << path << ".\n";
+        return false;
+    }
+
+    XNNPackOptions options;
+    options.threads = threads;
+    options.weight_cache = false;
+
+    state->delegate = create_xnnpack_delegate(options, nullptr);
+    state->interpreter = create_interpreter(*state->model, state->delegate.get(), threads);
+    if (!state->interpreter)
+        return false;
+
+    auto* interpreter = state->interpreter.get();
+    for (auto index : interpreter->inputs()) {
+        auto* tensor = interpreter->tensor(index);
+        runner.inputs.push_back({tensor->data.raw, tensor->bytes, tensor->type == kTfLiteFloat32});
+    }
+
+    runner.invoke = [interpreter] {
+        if (interpreter->Invoke() != kTfLiteOk) {
+            std::cerr << "error: failed to invoke interpreter.\n";
+            return false;
+        }
+        return true;
+    };
+    runner.owner = state;
+
+    return true;
+}
+
+rt::Result<void> create_optimium_runner(rt::Context& context, const std::string& path, int threads, Runner& runner) {
+    struct State {
+        rt::ModelOptions options; // for 0.3.10
+        rt::Model model;
+        rt::InferRequest request;
+        std::vector<rt::Tensor> inputs;
+        std::vector<std::unique_ptr<HeldBuffer>> buffers;  // of inputs, released first
+    };
+
+    auto state = std::make_shared<State>();
+    state->options.ThreadsCount = threads;
+    state->model = TRY(context.loadModel(path, rt::ArrayRef<rt::Device>(), state->options));
+    state->request = TRY(state->model.createRequest());
+    state->inputs = TRY(state->request.getInputTensors());
+
+    for (auto& tensor : state->inputs) {
+        auto& held = state->buffers.emplace_back(std::make_unique<HeldBuffer>(tensor));
+        runner.inputs.push_back({held->buffer.data(), tensor.getTensorSize(),
+                                 tensor.getType() == rt::ElementType::F32});
+    }
+
+    auto* request = &state->request;
+    runner.invoke = [request] {
+        auto result = [&]() -> rt::Result<void> {
+            CHECK(request->infer());
+            CHECK(request->wait());
+            return rt::Ok();
+        }();
+
+        if (!result.ok()) {
+            std::cerr << "failed to infer: " << result.error() << "\n";
+            return false;
+        }
+
+        return true;
+    };
+    runner.owner = state;
+
+    return rt::Ok();
+}
+
+void fill_inputs(const Runner& runner, const std::vector<char>& data, unsigned seed) {
+    std::mt19937 rng(seed);
+
+    if (!data.empty()) {
+        size_t offset = 0;
+        for (const auto& input : runner.inputs) {
+            auto* dst = static_cast<char*>(input.data);
+            for (size_t i = 0; i < input.bytes; ++i)
+                dst[i] = data[offset++ % data.size()];
+        }
+        return;
+    }
+
+    // floats in [0, 1] like a normalized image, raw bytes otherwise
+    std::uniform_real_distribution<float> real(0.0f, 1.0f);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    for (const auto& input : runner.inputs) {
+        if (input.is_float) {
+            auto* dst = static_cast<float*>(input.data);
+            for (size_t i = 0; i < input.bytes / sizeof(float); ++i)
+                dst[i] = real(rng);
+        } else {
+            auto* dst = static_cast<unsigned char*>(input.data);
+            for (size_t i = 0; i < input.bytes; ++i)
+                dst[i] = byte(rng);
+        }
+    }
+}
+
+Measurement measure(const Runner& runner, const Options& options) {
+    Measurement measurement;
+    measurement.window = LatencyWindow(options.runs);
+
+    for (auto i = 0; i < options.warmup; ++i) {
+        if (!runner.invoke())
+            return measurement;
+    }
+
+    double sum = 0.0;
+    for (auto i = 0; i < options.runs; ++i) {
+        auto begin = steady::now();
+        if (!runner.invoke())
+            return measurement;
+        auto us = std::chrono::duration<float, std::micro>(steady::now() - begin).count();
+
+        measurement.window.add(us);
+        sum += us;
+    }
+
+    measurement.ok = true;
+    measurement.mean = static_cast<float>(sum / options.runs);
+    return measurement;
+}
+
+std::string format_us(const Measurement& m) {
+    if (!m.ok)
+        return "-";
+
+    // thousands separators, as in the README
+    auto digits = std::to_string(static_cast<long>(m.mean + 0.5f));
+    for (int i = static_cast<int>(digits.size()) - 3; i > 0; i -= 3)
+        digits.insert(i, ",");
+    return digits;
+}
+
+void print_table(const std::vector<Row>& rows, const Options& options) {
+    std::cout << "\n### " << options.threads << " thread(s), mean of " << options.runs << " runs\n\n";
+    std::cout << "| Model        | XNNPACK(μs) | Optimium(μs) | Improvement |\n";
+    std::cout << "| ---------- | ------------- |------------- |-------------| \n";
+
+    for (const auto& row : rows) {
+        std::cout << "| " << row.name << " | " << format_us(row.xnnpack) << "    | " << format_us(row.optimium) << "    |";
+
+        if (row.xnnpack.ok && row.optimium.ok && row.optimium.mean > 0.0f) {
+            auto improvement = (row.xnnpack.mean / row.optimium.mean - 1.0f) * 100.0f;
+            std::cout << "**" << std::fixed << std::setprecision(1) << improvement << "%**    |\n";
+        } else {
+            std::cout << " -    |\n";
+        }
+    }
+
+    std::cout << "\n| Model        | Engine   | p50(μs) | p90(μs) | p99(μs) | max(μs) |\n";
+    std::cout << "|--------------|----------|---------|---------|---------|---------|\n";
+
+    auto percentiles = [](const std::string& name, const char* engine, const Measurement& m) {
+        if (!m.ok)
+            return;
+
+        std::cout << "| " << name << " | " << engine << std::fixed << std::setprecision(0)
+                  << " | " << m.window.percentile(50) << " | " << m.window.percentile(90)
+                  << " | " << m.window.percentile(99) << " | " << m.window.percentile(100) << " |\n";
+    };
+
+    for (const auto& row : rows) {
+        percentiles(row.name, "XNNPACK", row.xnnpack);
+        percentiles(row.name, "Optimium", row.optimium);
+    }
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (auto i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg.rfind("--", 0) != 0) {
+            options.models.push_back(arg);
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "error: missing value for " << arg << ".\n";
+            return false;
+        }
+
+        std::string value = argv[++i];
+        bool valid = true;
+        if (arg == "--threads") valid = parse_number(value, options.threads);
+        else if (arg == "--runs") valid = parse_number(value, options.runs);
+        else if (arg == "--warmup") valid = parse_number(value, options.warmup);
+        else if (arg == "--input") options.input = value;
+        else if (arg == "--seed") valid = parse_number(value, options.seed);
+        else {
+            std::cerr << "error: unknown option " << arg << ".\n";
+            return false;
+        }
+
+        if (!valid) {
+            std::cerr << "error: invalid value " << value << " for " << arg << ".\n";
+            return false;
+        }
+    }
+
+    options.threads = std::max(1, options.threads);
+    options.runs = std::max(1, options.runs);
+    options.warmup = std::max(0, options.warmup);
+
+    return !options.models.empty();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    std::vector<char> data;
+    if (!options.input.empty()) {
+        std::ifstream file(options.input, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (data.empty()) {
+            std::cerr << "error: failed to read " << options.input << ".\n";
+            return 2;
+        }
+    }
+
+    auto created = rt::Context::create();
+    if (!created.ok()) {
+        std::cerr << "failed to create context: " << created.error() << "\n";
+        return 2;
+    }
+    rt::Context context = created.value();
+
+    // one row per model name, in the order given
+    std::vector<std::string> stems;
+    for (const auto& model : options.models) {
+        auto stem = strip_extension(model);
+        if (std::find(stems.begin(), stems.end(), stem) == stems.end())
+            stems.push_back(stem);
+    }
+
+    std::vector<Row> rows;
+    for (const auto& stem : stems) {
+        Row row;
+        row.name = base_name(stem);
+
+        auto tflite_path = stem + ".tflite";
+        if (exists(tflite_path)) {
+            Runner runner;
+            if (create_tflite_runner(tflite_path, options.threads, runner)) {
+                fill_inputs(runner, data, options.seed);
+                row.xnnpack = measure(runner, options);
+            }
+        }
+
+        auto optimium_path = stem + ".model";
+        if (exists(optimium_path)) {
+            Runner runner;
+            auto result = create_optimium_runner(context, optimium_path, options.threads, runner);
+            if (result.ok()) {
+                fill_inputs(runner, data, options.seed);
+                row.optimium = measure(runner, options);
+            } else {
+                std::cerr << "failed to load " << optimium_path << ": " << result.error() << "\n";
+            }
+        }
+
+        if (!row.xnnpack.ok && !row.optimium.ok) {
+            std::cerr << "error: nothing to run for " << stem << ".\n";
+            continue;
+        }
+
+        std::cerr << row.name << ": done\n";
+        rows.push_back(std::move(row));
+    }
+
+    if (rows.empty())
+        return 1;
+
+    print_table(rows, options);
+    return 0;
+}
@@ -0,0 +1,417 @@
+// Offline reprocessing of a recording at full speed.
+//
+// Unlike recorded mode, no frame is skipped, replaced or paced: every frame
+// of the input is inferred in order and its result written to a JSONL (or
+// .bin) file, see ResultWriter.h. With --batch the palm detector runs on
+// several frames per invocation, which pays off on many-core machines.
+//
+// With --shards the input is split into frame ranges, each decoded and
+// inferred by its own reader, engine and cores. Every frame of MJPG and
+// raw frame files is a keyframe, so a shard starts exactly where it
+// should. Shards write their own result file and are merged in order.
+
+#include "InferEngine.h"
+#include "BatchDetector.h"
+#include "Defs.h"
+#include "FrameFile.h"
+#include "Preprocess.h"
+#include "ResultWriter.h"
+#include "ThreadBudget.h"
+#include "Affinity.h"
+#include "ParseNumber.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const auto usage = R"(usage: rpi-offline <input.avi|.frames> [options]
+  --engine NAME     tflite or optimium (default: tflite)
+  --threads N       inference threads per model (default: from the cores)
+  --batch N         frames per palm detector invocation, tflite only (default: 1)
+  --shards N        frame ranges processed in parallel, each with its own engine (default: 1)
+  --output FILE     results, binary if it ends in .bin (default: <input>.jsonl)
+)";
+
+struct Options {
+    std::string input;
+    std::string engine = "tflite";
+    int threads = 0;
+    int batch = 1;
+    int shards = 1;
+    std::string output;
+};
+
+// a range of frames and what processing it gave.
+struct Shard {
+    int64_t begin = 0;
+    int64_t end = 0;           // exclusive, -1 for the end of the input
+    std::string output;
+    std::vector<int> cores;    // empty for any core
+    std::promise<void> loaded; // set once the engine is created or failed
+
+    bool ok = false;
+    int64_t frames = 0;
+    int64_t detected = 0;
+    int batch = 1;
+    double seconds = 0.0;
+};
+
+// one frame of a batch and its preprocessing buffers.
+struct Slot {
+    cv::Mat frame;
+    cv::Mat rgb, resized, padded;
+    FrameStamp stamp;
+};
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (auto i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg.rfind("--", 0) != 0) {
+            options.input = arg;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "error: missing value for " << arg << ".\n";
+            return false;
+        }
+
+        std::string value = argv[++i];
+        bool valid = true;
+        if (arg == "--engine") options.engine = value;
+        else if (arg == "--threads") valid = parse_number(value, options.threads);
+        else if (arg == "--batch") valid = parse_number(value, options.batch);
+        else if (arg == "--shards") valid = parse_number(value, options.shards);
+        else if (arg == "--output") options.output = value;
+        else {
+            std::cerr << "error: unknown option " << arg << ".\n";
+            return false;
+        }
+
+        if (!valid) {
+            std::cerr << "error: invalid value " << value << " for " << arg << ".\n";
+            return false;
+        }
+    }
+
+    options.threads = std::max(0, options.threads);
+    options.batch = std::max(1, options.batch);
+    options.shards = std::max(1, options.shards);
+
+    if (options.engine != "tflite" && options.engine != "optimium") {
+        std::cerr << "error: unknown engine " << options.engine << ".\n";
+        return false;
+    }
+
+    return !options.input.empty();
+}
+
+FrameStamp::clock::time_point now() {
+    return FrameStamp::clock::now();
+}
+
+// raw frame files give the same pixels on every machine, decoders may not
+std::unique_ptr<cv::VideoCapture> open_input(const std::string& path) {
+    std::unique_ptr<cv::VideoCapture> reader;
+    if (FrameFileWriter::is_frame_file(path))
+        reader = std::make_unique<FrameFileCapture>();
+    else
+        reader = std::make_unique<cv::VideoCapture>();
+
+    if (!reader->open(path, cv::CAP_FFMPEG)) {
+        std::cerr << "error: failed to open " << path << ".\n";
+        return nullptr;
+    }
+
+    return reader;
+}
+
+// split the input into ranges of whole frames, fewer than asked if that
+// leaves them too short to be worth an engine each.
+std::vector<Shard> plan_shards(const Options& options, cv::VideoCapture& reader) {
+    auto total = static_cast<int64_t>(reader.get(cv::CAP_PROP_FRAME_COUNT));
+    auto count = options.shards;
+
+    if (count > 1 && total <= 0) {
+        std::cerr << "warning: " << options.input << " does not tell its length, processing it in one shard.\n";
+        count = 1;
+    }
+
+    if (count > 1) {
+        count = static_cast<int>(std::clamp<int64_t>(total / kOfflineMinShardFrames, 1, count));
+        if (count < options.shards)
+            std::cerr << "note: " << total << " frames are split into " << count << " shards only.\n";
+    }
+
+    if (count > 1 && !FrameFileWriter::is_frame_file(options.input) && reader.get(cv::CAP_PROP_FOURCC) != kMJPG)
+        std::cerr << "warning: " << options.input << " is not MJPG, each shard decodes from the keyframe before it.\n";
+
+    std::vector<Shard> shards(count);
+    auto cores = split_cores(count);
+
+    for (auto i = 0; i < count; ++i) {
+        auto& shard = shards[i];
+        shard.begin = total * i / count;
+        shard.end = (i + 1 < count) ? total * (i + 1) / count : -1;
+        shard.output = (count > 1) ? options.output + ".shard" + std::to_string(i) : options.output;
+        shard.cores = cores[i];
+    }
+
+    return shards;
+}
+
+void run_shard(const Options& options, const ThreadPlan& plan, Shard& shard) {
+    pin_current_thread(shard.cores);
+
+    auto threads = (options.threads > 0) ? options.threads : plan.engine_threads;
+
+    XNNPackOptions xnnpack;
+    xnnpack.threads = threads;
+    xnnpack.cores = shard.cores;
+
+    auto engine = (options.engine == "tflite") ? InferEngine::create_tflite_engine(xnnpack)
+                                               : InferEngine::create_optimium_engine(threads, shard.cores);
+    shard.loaded.set_value();
+    if (!engine)
+        return;
+
+    auto reader = open_input(options.input);
+    if (!reader)
+        return;
+
+    if (shard.begin > 0) {
+        reader->set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(shard.begin));
+        if (static_cast<int64_t>(reader->get(cv::CAP_PROP_POS_FRAMES)) != shard.begin) {
+            std::cerr << "error: failed to seek " << options.input << " to frame " << shard.begin << ".\n";
+            return;
+        }
+    }
+
+    // the shipped models are exported with a batch of 1; fall back to
+    // the engine's own detector if the graph cannot be batched.
+    std::unique_ptr<BatchDetector> detector;
+    if (options.batch > 1) {
+        if (options.engine == "tflite")
+            detector = BatchDetector::create_tflite(options.batch, xnnpack);
+        else
+            std::cerr << "error: optimium models are compiled for batch 1.\n";
+
+        if (!detector)
+            std::cerr << "warning: detecting one frame at a time.\n";
+    }
+
+    shard.batch = detector ? detector->batch() : 1;
+
+    // merged shards must not rotate, or their parts would interleave
+    ResultWriterOptions writer_options;
+    writer_options.format = ResultWriter::format_of(options.output);
+    writer_options.block = true;
+    if (shard.output != options.output)
+        writer_options.rotate_bytes = 0;
+
+    ResultWriter results(shard.output, writer_options);
+    if (results.open())
+        return;
+
+    std::vector<Slot> slots(shard.batch);
+    std::vector<cv::Point> landmarks;
+    std::vector<cv::Rect> faces;
+    auto next = shard.begin;
+    bool more = true;
+
+    auto begin = now();
+
+    while (more) {
+        // read and preprocess a batch, straight into the detector inputs
+        int count = 0;
+        for (; count < shard.batch; ++count) {
+            auto& slot = slots[count];
+            if ((shard.end >= 0 && next >= shard.end) || !reader->read(slot.frame)) {
+                more = false;
+                break;
+            }
+
+            slot.stamp.sequence = next++;
+            slot.stamp.captured = now();
+            preprocessFrame(slot.frame, slot.rgb, slot.resized, slot.padded,
+                            detector ? detector->input(count) : engine->det_input());
+        }
+
+        if (count == 0)
+            break;
+
+        if (detector && !detector->invoke())
+            return;
+
+        auto preprocessed = now();
+
+        for (auto i = 0; i < count; ++i) {
+            auto& slot = slots[i];
+            faces.clear();
+
+            bool detected = detector
+                ? engine->do_infer(detector->boxes(i), detector->scores(i), slot.padded, landmarks, faces)
+                : engine->do_infer(slot.padded, landmarks, faces);
+
+            ResultStamp stamp;
+            stamp.frame = slot.stamp;
+            stamp.preprocessed = preprocessed;
+            stamp.inferred = now();
+            results.append(stamp, detected, faces, *engine);
+
+            shard.detected += detected;
+        }
+
+        shard.frames += count;
+    }
+
+    shard.seconds = std::chrono::duration<double>(now() - begin).count();
+    results.close();
+    shard.ok = true;
+}
+
+bool append_file(int out, const std::string& path, off_t skip) {
+    int in = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        std::cerr << "error: failed to open " << path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    std::vector<char> buffer(kResultLogBuffer);
+    bool ok = lseek(in, skip, SEEK_SET) == skip;
+
+    while (ok) {
+        auto n = ::read(in, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+
+        for (ssize_t done = 0; ok && done < n;) {
+            auto written = ::write(out, buffer.data() + done, n - done);
+            if (written < 0 && errno != EINTR)
+                ok = false;
+            else if (written > 0)
+                done += written;
+        }
+    }
+
+    if (!ok)
+        std::cerr << "error: failed to merge " << path << ": " << strerror(errno) << "\n";
+
+    ::close(in);
+    return ok;
+}
+
+// concatenate the shards' results in frame order, binary files keep only
+// the first shard's header.
+bool merge_results(const Options& options, const std::vector<Shard>& shards) {
+    int out = ::open(options.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        std::cerr << "error: failed to open " << options.output << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    auto binary = ResultWriter::format_of(options.output) == ResultFormat::Binary;
+    bool ok = true;
+
+    for (size_t i = 0; i < shards.size() && ok; ++i) {
+        off_t skip = (binary && i > 0) ? sizeof(ResultFileHeader) : 0;
+        ok = append_file(out, shards[i].output, skip);
+    }
+
+    ::close(out);
+
+    if (ok) {
+        for (const auto& shard : shards)
+            std::remove(shard.output.c_str());
+    }
+
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    if (options.output.empty())
+        options.output = options.input + ".jsonl";
+
+    auto reader = open_input(options.input);
+    if (!reader)
+        return 2;
+
+    auto shards = plan_shards(options, *reader);
+    reader.reset();
+
+    ThreadBudget budget;
+    auto plan = budget.plan(shards.size());
+    budget.apply(plan);
+
+    auto begin = now();
+
+    if (shards.size() == 1) {
+        run_shard(options, plan, shards[0]);
+    } else {
+        // the first engine builds any missing weight cache, the others
+        // start once it is there and map it.
+        std::vector<std::thread> workers;
+        for (auto& shard : shards) {
+            workers.emplace_back(run_shard, std::cref(options), std::cref(plan), std::ref(shard));
+            if (workers.size() == 1)
+                shard.loaded.get_future().wait();
+        }
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    int64_t frames = 0;
+    int64_t detected = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        const auto& shard = shards[i];
+        if (!shard.ok) {
+            std::cerr << "error: shard " << i << " from frame " << shard.begin << " failed.\n";
+            return 1;
+        }
+
+        if (shards.size() > 1)
+            std::cout << "shard " << i << ": " << shard.frames << " frames from " << shard.begin << " in "
+                      << shard.seconds << "s (" << shard.frames / std::max(shard.seconds, 1e-9) << " FPS)\n";
+
+        frames += shard.frames;
+        detected += shard.detected;
+    }
+
+    if (shards.size() > 1 && !merge_results(options, shards))
+        return 1;
+
+    auto seconds = std::chrono::duration<double>(now() - begin).count();
+
+    std::cout << frames << " frames in " << seconds << "s (" << frames / std::max(seconds, 1e-9) << " FPS) on "
+              << shards.size() << " shards at batch " << shards[0].batch << ", hand in " << detected
+              << ", results in " << options.output << ".\n";
+
+    return 0;
+}
@@ -0,0 +1,402 @@
+// Numerical equivalence and latency regression check for the engines.
+//
+// Runs a fixed corpus of frames (a recording of the demo, e.g.
+// outputs/record_data_*.avi or .frames) through TFLite and Optimium,
+// compares the palm box and 21 landmarks of every frame against stored
+// goldens and per-stage p50/p99 latency against a stored baseline. Exits with 1 on any failure,
+// so it can gate runtime and model upgrades.
+//
+// Record goldens (from TFLite) and the latency baseline with --update.
+
+#include "InferEngine.h"
+#include "Defs.h"
+#include "Preprocess.h"
+#include "LatencyWindow.h"
+#include "FrameFile.h"
+#include "ParseNumber.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const auto usage = R"(usage: rpi-regress <corpus.avi|.frames> [options]
+  --golden FILE        landmark goldens (default: regress_golden.txt)
+  --baseline FILE      latency baseline (default: regress_baseline.txt)
+  --update             record goldens and baseline instead of checking
+  --repeat N           passes over the corpus for latency (default: 3)
+  --box-tol PX         allowed palm box error (default: 8)
+  --landmark-tol PX    allowed landmark error (default: 6)
+  --latency-tol PCT    allowed p50/p99 regression (default: 10)
+)";
+
+struct Options {
+    std::string corpus;
+    std::string golden = "regress_golden.txt";
+    std::string baseline = "regress_baseline.txt";
+    bool update = false;
+    int repeat = 3;
+    float box_tolerance = 8.0f;
+    float landmark_tolerance = 6.0f;
+    float latency_tolerance = 10.0f;
+};
+
+struct FrameResult {
+    bool detected = false;
+    cv::Rect box;
+    std::vector<cv::Point> landmarks;
+};
+
+constexpr const char* kStageNames[] = { "detector", "detector_post", "landmark", "landmark_post", "total" };
+constexpr int kStageCount = 5;
+
+struct EngineRun {
+    const char* name;
+    std::vector<FrameResult> results;
+    std::vector<LatencyWindow> stages;
+};
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (auto i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char* { return (i + 1 < argc) ? argv[++i] : nullptr; };
+
+        if (arg == "--update") {
+            options.update = true;
+            continue;
+        }
+
+        if (arg.rfind("--", 0) != 0) {
+            options.corpus = arg;
+            continue;
+        }
+
+        const char* value = next();
+        if (value == nullptr) {
+            std::cerr << "error: missing value for " << arg << ".\n";
+            return false;
+        }
+
+        bool valid = true;
+        if (arg == "--golden") options.golden = value;
+        else if (arg == "--baseline") options.baseline = value;
+        else if (arg == "--repeat") valid = parse_number(value, options.repeat) && options.repeat >= 1;
+        else if (arg == "--box-tol") valid = parse_number(value, options.box_tolerance) && options.box_tolerance >= 0.0f;
+        else if (arg == "--landmark-tol") valid = parse_number(value, options.landmark_tolerance) && options.landmark_tolerance >= 0.0f;
+        else if (arg == "--latency-tol") valid = parse_number(value, options.latency_tolerance) && options.latency_tolerance >= 0.0f;
+        else {
+            std::cerr << "error: unknown option " << arg << ".\n";
+            return false;
+        }
+
+        if (!valid) {
+            std::cerr << "error: invalid value " << value << " for " << arg << ".\n";
+            return false;
+        }
+    }
+
+    return !options.corpus.empty();
+}
+
+bool load_corpus(const std::string& path, std::vector<cv::Mat>& frames) {
+    // raw frame files give the same pixels on every machine, decoders may not
+    FrameFileCapture raw;
+    cv::VideoCapture video;
+    cv::VideoCapture& reader = FrameFileWriter::is_frame_file(path) ? static_cast<cv::VideoCapture&>(raw) : video;
+
+    if (!reader.open(path, cv::CAP_FFMPEG)) {
+        std::cerr << "error: failed to open " << path << ".\n";
+        return false;
+    }
+
+    cv::Mat frame;
+    while (reader.read(frame))
+        frames.push_back(frame.clone());
+
+    if (frames.empty()) {
+        std::cerr << "error: " << path << " has no frame.\n";
+        return false;
+    }
+
+    return true;
+}
+
+void run_engine(InferEngine& engine, const std::vector<cv::Mat>& frames, int repeat, EngineRun& run) {
+    cv::Mat rgb, resized, padded;
+    std::vector<cv::Point> landmarks;
+    std::vector<cv::Rect> boxes;
+
+    run.results.resize(frames.size());
+    run.stages.assign(kStageCount, LatencyWindow(frames.size() * repeat));
+
+    for (auto pass = 0; pass < repeat; ++pass) {
+        for (size_t i = 0; i < frames.size(); ++i) {
+            landmarks.clear();
+            boxes.clear();
+
+            preprocessFrame(frames[i], rgb, resized, padded, engine.det_input());
+            bool detected = engine.do_infer(padded, landmarks, boxes);
+
+            const auto& stages = engine.last_stages();
+            run.stages[0].add(stages.detector);
+            run.stages[1].add(stages.detector_post);
+            if (detected) {
+                run.stages[2].add(stages.landmark);
+                run.stages[3].add(stages.landmark_post);
+            }
+            run.stages[4].add(stages.total());
+
+            if (pass == 0) {
+                auto& result = run.results[i];
+                result.detected = detected;
+                if (detected) {
+                    result.box = boxes.front();
+                    result.landmarks = landmarks;
+                }
+            }
+        }
+    }
+}
+
+bool write_golden(const std::string& path, const std::vector<FrameResult>& results) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "error: failed to open " << path << ".\n";
+        return false;
+    }
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        file << i << ' ' << result.detected;
+
+        if (result.detected) {
+            file << ' ' << result.box.x << ' ' << result.box.y << ' ' << result.box.width << ' ' << result.box.height;
+            for (const auto& point : result.landmarks)
+                file << ' ' << point.x << ' ' << point.y;
+        }
+
+        file << '\n';
+    }
+
+    return true;
+}
+
+bool read_golden(const std::string& path, std::vector<FrameResult>& results) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "error: failed to open " << path << ". record it with --update.\n";
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        size_t index;
+        FrameResult result;
+
+        if (!(stream >> index >> result.detected))
+            continue;
+
+        if (result.detected) {
+            stream >> result.box.x >> result.box.y >> result.box.width >> result.box.height;
+
+            cv::Point point;
+            while (stream >> point.x >> point.y)
+                result.landmarks.push_back(point);
+        }
+
+        if (index >= results.size())
+            results.resize(index + 1);
+        results[index] = std::move(result);
+    }
+
+    return true;
+}
+
+bool write_baseline(const std::string& path, const std::vector<EngineRun>& runs) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "error: failed to open " << path << ".\n";
+        return false;
+    }
+
+    for (const auto& run : runs) {
+        for (auto i = 0; i < kStageCount; ++i)
+            file << run.name << ' ' << kStageNames[i] << ' ' << run.stages[i].percentile(50) << ' ' << run.stages[i].percentile(99) << '\n';
+    }
+
+    return true;
+}
+
+// compare against goldens. returns number of failing frames.
+int check_results(const EngineRun& run, const std::vector<FrameResult>& golden, const Options& options) {
+    int failures = 0;
+
+    if (golden.size() != run.results.size()) {
+        std::cerr << "FAIL " << run.name << ": corpus has " << run.results.size() << " frames, goldens " << golden.size() << ".\n";
+        return 1;
+    }
+
+    for (size_t i = 0; i < golden.size(); ++i) {
+        const auto& expected = golden[i];
+        const auto& actual = run.results[i];
+
+        if (expected.detected != actual.detected) {
+            std::cerr << "FAIL " << run.name << " frame " << i << ": detected " << actual.detected << ", expected " << expected.detected << ".\n";
+            ++failures;
+            continue;
+        }
+
+        if (!expected.detected)
+            continue;
+
+        float box_error = std::max({
+            std::abs(expected.box.x - actual.box.x),
+            std::abs(expected.box.y - actual.box.y),
+            std::abs(expected.box.width - actual.box.width),
+            std::abs(expected.box.height - actual.box.height)
+        }) * 1.0f;
+
+        float landmark_error = 0.0f;
+        if (expected.landmarks.size() != actual.landmarks.size()) {
+            landmark_error = INFINITY;
+        } else {
+            for (size_t j = 0; j < expected.landmarks.size(); ++j) {
+                auto d = expected.landmarks[j] - actual.landmarks[j];
+                landmark_error = std::max(landmark_error, std::hypot(static_cast<float>(d.x), static_cast<float>(d.y)));
+            }
+        }
+
+        if (box_error > options.box_tolerance || landmark_error > options.landmark_tolerance) {
+            std::cerr << "FAIL " << run.name << " frame " << i << ": box error " << box_error << "px, landmark error " << landmark_error << "px.\n";
+            ++failures;
+        }
+    }
+
+    return failures;
+}
+
+// compare against baseline. returns number of regressed stages, counting
+// stages missing from it.
+int check_latency(const std::vector<EngineRun>& runs, const Options& options) {
+    std::ifstream file(options.baseline);
+    if (!file.is_open()) {
+        std::cerr << "error: failed to open " << options.baseline << ". record it with --update.\n";
+        return 1;
+    }
+
+    int failures = 0;
+    auto limit = 1.0f + options.latency_tolerance / 100.0f;
+
+    std::vector<std::vector<bool>> found(runs.size(), std::vector<bool>(kStageCount, false));
+
+    std::string engine, stage;
+    float p50, p99;
+    while (file >> engine >> stage >> p50 >> p99) {
+        for (size_t r = 0; r < runs.size(); ++r) {
+            const auto& run = runs[r];
+            if (engine != run.name)
+                continue;
+
+            for (auto i = 0; i < kStageCount; ++i) {
+                if (stage != kStageNames[i])
+                    continue;
+
+                found[r][i] = true;
+
+                auto current_p50 = run.stages[i].percentile(50);
+                auto current_p99 = run.stages[i].percentile(99);
+
+                if (current_p50 > p50 * limit || current_p99 > p99 * limit) {
+                    std::cerr << "FAIL " << engine << " " << stage << ": p50 " << current_p50 << "ms (baseline " << p50
+                              << "ms), p99 " << current_p99 << "ms (baseline " << p99 << "ms).\n";
+                    ++failures;
+                }
+            }
+        }
+    }
+
+    // a truncated or older baseline must not pass for what it lacks
+    for (size_t r = 0; r < runs.size(); ++r) {
+        for (auto i = 0; i < kStageCount; ++i) {
+            if (!found[r][i]) {
+                std::cerr << "FAIL " << runs[r].name << " " << kStageNames[i] << ": missing from " << options.baseline << ".\n";
+                ++failures;
+            }
+        }
+    }
+
+    return failures;
+}
+
+void print_latency(const EngineRun& run) {
+    std::cout << run.name << ":\n";
+    for (auto i = 0; i < kStageCount; ++i) {
+        std::cout << "  - " << kStageNames[i] << ": p50 " << run.stages[i].percentile(50)
+                  << "ms / p99 " << run.stages[i].percentile(99) << "ms\n";
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    std::vector<cv::Mat> frames;
+    if (!load_corpus(options.corpus, frames))
+        return 2;
+
+    auto tflite = InferEngine::create_tflite_engine();
+    auto optimium = InferEngine::create_optimium_engine();
+    if (!tflite || !optimium)
+        return 2;
+
+    std::vector<EngineRun> runs(2);
+    runs[0].name = "tflite";
+    runs[1].name = "optimium";
+
+    run_engine(*tflite, frames, options.repeat, runs[0]);
+    run_engine(*optimium, frames, options.repeat, runs[1]);
+
+    for (const auto& run : runs)
+        print_latency(run);
+
+    if (options.update) {
+        // tflite is the reference implementation.
+        if (!write_golden(options.golden, runs[0].results) || !write_baseline(options.baseline, runs))
+            return 2;
+
+        std::cout << "recorded " << frames.size() << " frames to " << options.golden << " and " << options.baseline << ".\n";
+        return 0;
+    }
+
+    std::vector<FrameResult> golden;
+    if (!read_golden(options.golden, golden))
+        return 2;
+
+    int failures = 0;
+    for (const auto& run : runs)
+        failures += check_results(run, golden, options);
+    failures += check_latency(runs, options);
+
+    if (failures != 0) {
+        std::cout << failures << " check(s) failed.\n";
+        return 1;
+    }
+
+    std::cout << "all checks passed.\n";
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Replays a tensor capture through the post-processing, without a camera or
+// models.
+//
+// Capture one with recorded mode (RPI_DEMO_TENSOR_CAPTURE=1), then
+//   rpi-replay outputs/record_tflite_<timestamp>.capture
+// runs every record as fast as the CPU allows, checks that each result is
+// bit-exact with what the capturing engine computed and prints the
+// post-processing latency. Exits with 1 on any mismatch.
+
+#include "InferEngine.h"
+#include "TensorCapture.h"
+#include "LatencyWindow.h"
+#include "ParseNumber.h"
+
+#include <opencv2/core.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const auto usage = R"(usage: rpi-replay <capture> [options]
+  --runs N      passes over the capture (default: 1)
+)";
+
+using steady = std::chrono::steady_clock;
+
+// first differing record of a pass, -1 if none.
+int64_t replay(const std::string& path, const CaptureReader& reader, LatencyWindow& detector_post,
+               LatencyWindow& landmark_post, int64_t& mismatches) {
+    auto engine = InferEngine::create_replay_engine(path);
+    if (!engine)
+        return -2;
+
+    // the crop is replaced by the captured one; any padded frame will do
+    cv::Mat padded(kWidth, kWidth, CV_8UC3, cv::Scalar::all(0));
+    std::vector<cv::Point> landmarks;
+    std::vector<cv::Rect> faces;
+    int64_t first = -1;
+
+    for (size_t i = 0; i < reader.size(); ++i) {
+        const auto& record = *reader.at(i).record;
+
+        faces.clear();
+        bool detected = engine->do_infer(padded, landmarks, faces);
+
+        const auto& stages = engine->last_stages();
+        detector_post.add(stages.detector_post);
+        landmark_post.add(stages.landmark_post);
+
+        bool expected = (record.flags & kCaptureDetected) != 0;
+        bool same = (detected == expected);
+
+        if (same && detected) {
+            const auto& precise = engine->precise_landmarks();
+            for (size_t k = 0; k < precise.size() && same; ++k) {
+                same = std::memcmp(&precise[k].x, &record.landmarks[k][0], sizeof(float)) == 0 &&
+                       std::memcmp(&precise[k].y, &record.landmarks[k][1], sizeof(float)) == 0;
+            }
+        }
+
+        if (!same) {
+            mismatches += 1;
+            if (first < 0)
+                first = record.index;
+        }
+    }
+
+    return first;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string path;
+    int runs = 1;
+
+    for (auto i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "--runs" && i + 1 < argc) {
+            if (!parse_number(std::string(argv[++i]), runs)) {
+                std::cerr << "error: invalid value " << argv[i] << " for " << arg << ".\n" << usage;
+                return 2;
+            }
+            runs = std::max(1, runs);
+        } else if (arg.rfind("--", 0) != 0 && path.empty()) {
+            path = arg;
+        } else {
+            std::cerr << usage;
+            return 2;
+        }
+    }
+
+    if (path.empty()) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    CaptureReader reader;
+    if (!reader.open(path)) {
+        std::cerr << "error: " << path << " is not a tensor capture of this build.\n";
+        return 2;
+    }
+
+    if (reader.size() == 0) {
+        std::cerr << "error: " << path << " has no records.\n";
+        return 2;
+    }
+
+    auto samples = reader.size() * runs;
+    LatencyWindow detector_post(samples);
+    LatencyWindow landmark_post(samples);
+    int64_t mismatches = 0;
+
+    auto begin = steady::now();
+    for (auto run = 0; run < runs; ++run) {
+        auto first = replay(path, reader, detector_post, landmark_post, mismatches);
+        if (first == -2)
+            return 2;
+        if (first >= 0 && run == 0)
+            std::cerr << "first mismatch at record " << first << "\n";
+    }
+    auto seconds = std::chrono::duration<double>(steady::now() - begin).count();
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "replayed " << reader.size() << " records x " << runs << " in " << seconds << "s, "
+              << std::setprecision(0) << samples / seconds << " frames/s\n";
+    std::cout << std::setprecision(3);
+    std::cout << "  - detector_post: p50 " << detector_post.percentile(50) << "ms / p99 " << detector_post.percentile(99) << "ms\n";
+    std::cout << "  - landmark_post: p50 " << landmark_post.percentile(50) << "ms / p99 " << landmark_post.percentile(99) << "ms\n";
+
+    if (mismatches > 0) {
+        std::cout << mismatches << " results differ from the capture.\n";
+        return 1;
+    }
+
+    std::cout << "all results bit-exact.\n";
+    return 0;
+}